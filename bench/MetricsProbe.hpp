@@ -0,0 +1,70 @@
+#pragma once
+#include <MetricsModel/MetricsModel>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Доступ metrics_bench и metrics_stress к внутренностям модели без io-потоков и сети:
+/// MetricsModel и NotifyManager объявляют его другом
+struct MetricsModelProbe {
+    MetricsModel &model;
+
+    /// Такт модели синхронно в вызывающем потоке; загрузчики и правила, как обычно, уходят в strand
+    void tick() { model.timer_handler(std::chrono::milliseconds(model.config.statisticInterval * 1000)); }
+
+    /// Проверка правил группы 0 в strand NotifyManager, как на такте, но без очередей провайдеров; ждет результата
+    NotifierSystem::NotifyManager::Messages checkRules()
+    {
+        std::promise<NotifierSystem::NotifyManager::Messages> result;
+        auto messages = result.get_future();
+        boost::asio::post(model.notifier_strand_, [this, &result] {
+            std::lock_guard<std::mutex> lock(model.providers_mutex_);
+            Metrics::Registry::Walk walk(model.registry_);
+            result.set_value(model.notifier_manager.upload(model.registry_, model.history_));
+        });
+        return messages.get();
+    }
+
+    /// Правило, как из секции notifiers конфигурации; до MetricsModel::postInit
+    void addRule(const std::string &metric, const std::string &condition, size_t interval_ms = 0)
+    {
+        auto rule                     = std::make_unique<NotifierSystem::Notify>();
+        rule->metric.value            = metric;
+        rule->condition.text.value    = condition;
+        rule->interval_ms.value       = interval_ms;
+        rule->alertStartMessage.value = "Alert! {metric}:{value} {tags} for {duration}";
+        model.notifier_manager.notifiers.items.push_back(std::move(rule));
+    }
+
+    /// Снимок, как для загрузчиков на такте: сбор без истории и проход по реестру
+    std::shared_ptr<const Metrics::Snapshot> snapshot()
+    {
+        model.collect(false);
+        return model.takeSnapshot(false);
+    }
+
+    /// Сбор и сравнение значений ValueStore с обходом объектов Metric по реестру, как без хранилища:
+    /// количество пар (series_id, значение), которые есть только в одном из двух; 0 без хранилища
+    size_t storeMismatches()
+    {
+        if (!model.values_.enabled()) return 0;
+        model.collect(false);
+        std::vector<std::pair<uint32_t, size_t>> store, walk;
+        Metrics::Registry::Walk lock(model.registry_);
+        model.values_.forEach([&](uint32_t id, uint8_t, size_t value) { store.emplace_back(id, value); });
+        model.registry_.forEach([&](Metrics::Metric *metric) { walk.emplace_back(metric->series_id, metric->value()); });
+        std::ranges::sort(store);
+        std::ranges::sort(walk);
+        std::vector<std::pair<uint32_t, size_t>> diff;
+        std::ranges::set_symmetric_difference(store, walk, std::back_inserter(diff));
+        return diff.size();
+    }
+
+    size_t registrySize() const { return model.registry_.size(); }
+};
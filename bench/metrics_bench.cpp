@@ -0,0 +1,516 @@
+// metrics_bench: пропускная способность горячих путей библиотеки без сети.
+// Каждый замер — одна строка JSON в stdout, строки двух запусков сравниваются по полям bench и параметрам.
+//   metrics_bench [--filter <подстрока>] [--min-ms <мс на замер>] [--max-series <серий>] [--value-store 0|1]
+#include "MetricsProbe.hpp"
+#include <MetricsModel/AlertTemplate>
+#include <MetricsModel/MetricsEncoder>
+#include <MetricsModel/MetricsSnapshotFile>
+#include <MetricsModel/MetricsTimer>
+#include <MetricsModel/StaticMetrics>
+#include <boost/algorithm/string/replace.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::string filter;
+        size_t min_ms     = 300;
+        size_t max_series = 1'000'000;
+        bool value_store  = false;
+    } options;
+
+    bool store_mismatch = false; /// Значения ValueStore в collect разошлись с обходом реестра
+
+    constexpr size_t rules_per_metric = 50; /// Правил на "bench_rules_counter" в rule_check
+
+    bool selected(const std::string &bench) { return bench.find(options.filter) != std::string::npos; }
+
+    /// {"bench":"...",<params>,"ops":N,"seconds":S,"ns_per_op":X,"ops_per_sec":Y}
+    void report(const std::string &bench, const std::string &params, size_t ops, double seconds)
+    {
+        std::printf("{\"bench\":\"%s\"%s%s,\"ops\":%zu,\"seconds\":%.6f,\"ns_per_op\":%.3f,\"ops_per_sec\":%.1f}\n",
+                    bench.c_str(), params.empty() ? "" : ",", params.c_str(), ops, seconds, seconds * 1e9 / ops,
+                    ops / seconds);
+        std::fflush(stdout);
+    }
+
+    /// Повторяет body(n) с удвоением n, пока один прогон не займет min_ms; возвращает (n, секунды)
+    template <class Body> std::pair<size_t, double> measure(Body &&body, size_t n = 1024)
+    {
+        for (;; n *= 2) {
+            auto start   = Clock::now();
+            body(n);
+            auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            if (seconds * 1000 >= options.min_ms || n >= (size_t(1) << 40)) return {n, seconds};
+        }
+    }
+
+    /// Постоянные потоки замеров: у каждого один threadIndex() на все замеры, как у рабочих потоков приложения,
+    /// а не новый на каждый прогон, иначе строки Histogram и шарды быстро кончаются
+    class Pool
+    {
+    public:
+        static constexpr size_t max_threads = 64;
+
+        Pool()
+        {
+            for (size_t t = 0; t < max_threads; t++) workers_.emplace_back([this, t] { loop(t); });
+        }
+        ~Pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+                generation_++;
+            }
+            wake_.notify_all();
+            for (auto &worker : workers_) worker.join();
+        }
+
+        /// body(t) на каждом из threads потоков, стартующих одновременно; секунды от старта до последнего
+        double run(size_t threads, const std::function<void(size_t)> &body)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                body_    = &body;
+                threads_ = threads;
+                ready_   = 0;
+                done_    = 0;
+                generation_++;
+            }
+            wake_.notify_all();
+            while (ready_ != threads) std::this_thread::yield();
+            auto start = Clock::now();
+            go_        = true;
+            while (done_ != threads) std::this_thread::yield();
+            auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            go_          = false;
+            return seconds;
+        }
+
+    private:
+        void loop(size_t t)
+        {
+            size_t seen = 0;
+            for (;;) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return generation_ != seen; });
+                seen = generation_;
+                if (stop_) return;
+                if (t >= threads_) continue;
+                auto body = body_;
+                lock.unlock();
+                ready_++;
+                while (!go_) std::this_thread::yield();
+                (*body)(t);
+                done_++;
+            }
+        }
+
+        std::vector<std::thread> workers_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        size_t generation_ = 0, threads_ = 0;
+        bool stop_         = false;
+        const std::function<void(size_t)> *body_ = nullptr;
+        std::atomic<size_t> ready_ = 0, done_ = 0;
+        std::atomic<bool> go_      = false;
+    };
+
+    template <class Body> double runThreads(size_t threads, Body &&body)
+    {
+        static Pool pool;
+        return pool.run(threads, body);
+    }
+
+    void benchIncrements()
+    {
+        // Plain допускает только один пишущий поток, поэтому многопоточно меряется Sharded
+        for (auto [kind, mode, max_threads] : {std::tuple{"plain", Metrics::Mode::Plain, size_t(1)},
+                                               std::tuple{"sharded", Metrics::Mode::Sharded, size_t(64)}})
+            for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+                auto params = "\"mode\":\"" + std::string(kind) + "\",\"threads\":" + std::to_string(threads);
+                if (selected("counter_inc")) {
+                    Metrics::Counter counter("bench_counter", {}, mode);
+                    auto [n, seconds] = measure([&](size_t n) {
+                        return runThreads(threads, [&](size_t) {
+                            for (size_t i = 0; i < n; i++) counter++;
+                        });
+                    }, 1 << 16);
+                    report("counter_inc", params, n * threads, seconds);
+                }
+                if (selected("gauge_inc")) {
+                    Metrics::Gauge gauge("bench_gauge", {}, mode);
+                    auto [n, seconds] = measure([&](size_t n) {
+                        return runThreads(threads, [&](size_t) {
+                            for (size_t i = 0; i < n; i++) gauge++;
+                        });
+                    }, 1 << 16);
+                    report("gauge_inc", params, n * threads, seconds);
+                }
+            }
+    }
+
+    void benchHistogram()
+    {
+        if (!selected("histogram_record")) return;
+        Metrics::Histogram histogram("bench_histogram", Metrics::Histogram::Buckets::logLinear(1 << 20));
+        for (size_t threads = 1; threads <= 64; threads *= 2) {
+            auto [n, seconds] = measure([&](size_t n) {
+                return runThreads(threads, [&](size_t t) {
+                    for (size_t i = 0; i < n; i++) histogram.record((i * 7919 + t) & 0xfffff);
+                });
+            }, 1 << 16);
+            report("histogram_record", "\"threads\":" + std::to_string(threads), n * threads, seconds);
+        }
+    }
+
+    void benchTimer()
+    {
+        // Часы выбираются при сборке (METRICS_TIMER_CLOCK), в параметрах — какие собраны
+        if (!selected("scoped_timer")) return;
+        Metrics::Histogram histogram("bench_timer_us", Metrics::Histogram::Buckets::logLinear(1 << 20));
+        for (uint32_t sample_every : {1u, 64u}) {
+            auto [n, seconds] = measure([&](size_t n) {
+                for (size_t i = 0; i < n; i++)
+                    Metrics::ScopedTimer<Metrics::Histogram> timer(histogram, Metrics::TimeUnit::Nanoseconds, sample_every);
+            }, 1 << 16);
+            report("scoped_timer",
+                   "\"clock\":\"" + std::string(Metrics::TimerClock::name()) + "\",\"sample_every\":" +
+                       std::to_string(sample_every),
+                   n, seconds);
+        }
+    }
+
+    void benchStatic()
+    {
+        // Одно общее значение на все потоки: цена разделяемой кэш-линии против Sharded в counter_inc
+        if (!selected("static_counter")) return;
+        Metrics::StaticCounter<"bench_static", Metrics::StaticTag<"peer", "bench">> counter;
+        for (size_t threads = 1; threads <= 64; threads *= 2) {
+            auto [n, seconds] = measure([&](size_t n) {
+                return runThreads(threads, [&](size_t) {
+                    for (size_t i = 0; i < n; i++) counter++;
+                });
+            }, 1 << 16);
+            report("static_counter", "\"threads\":" + std::to_string(threads), n * threads, seconds);
+        }
+    }
+
+    void benchChurn(MetricsModelProbe &probe)
+    {
+        // Ключи повторяются: после первого круга intern только находит уже известную серию
+        if (!selected("metric_churn")) return;
+        std::vector<std::vector<Metrics::Tag>> tags;
+        for (size_t i = 0; i < 1024; i++) tags.push_back({{"peer", "peer" + std::to_string(i)}});
+        // upload: соседний поток непрерывно выполняет такты над 10k серий, почти всегда держа обход реестра
+        for (bool upload : {false, true}) {
+            std::vector<std::unique_ptr<Metrics::Counter>> counters;
+            std::atomic<bool> done = false;
+            std::thread ticker;
+            if (upload) {
+                for (size_t i = 0; i < 10'000; i++)
+                    counters.push_back(std::make_unique<Metrics::Counter>(
+                        "bench_churn_upload", std::vector<Metrics::Tag>{{"i", std::to_string(i)}}, Metrics::Mode::Sharded));
+                ticker = std::thread([&] {
+                    while (!done) probe.tick();
+                });
+            }
+            for (auto [kind, mode] :
+                 {std::pair{"plain", Metrics::Mode::Plain}, std::pair{"sharded", Metrics::Mode::Sharded}}) {
+                auto [n, seconds] = measure([&](size_t n) {
+                    for (size_t i = 0; i < n; i++) Metrics::Counter counter("bench_churn", tags[i % tags.size()], mode);
+                });
+                report("metric_churn", "\"mode\":\"" + std::string(kind) + "\",\"upload\":" + (upload ? "true" : "false"),
+                       n, seconds);
+            }
+            done = true;
+            if (ticker.joinable()) ticker.join();
+        }
+    }
+
+    void benchCollect(MetricsModelProbe &probe)
+    {
+        if (!selected("collect")) return;
+        for (size_t series : {size_t(1'000), size_t(100'000), size_t(1'000'000)}) {
+            if (series > options.max_series) break;
+            std::vector<std::unique_ptr<Metrics::Counter>> counters;
+            counters.reserve(series);
+            // Половина Plain: с хранилищем они пишут прямо в ячейку, Sharded сливаются по списку сбора
+            for (size_t i = 0; i < series; i++)
+                counters.push_back(std::make_unique<Metrics::Counter>(
+                    "bench_collect", std::vector<Metrics::Tag>{{"i", std::to_string(i)}},
+                    i % 2 ? Metrics::Mode::Plain : Metrics::Mode::Sharded));
+            auto [n, seconds] = measure([&](size_t n) {
+                for (size_t i = 0; i < n; i++) probe.tick();
+            }, 1);
+            // С хранилищем сбор — линейный проход по блокам; его результат сверяется с обходом объектов Metric
+            for (size_t i = 0; i < series; i += 7) *counters[i] += i;
+            auto mismatches = probe.storeMismatches();
+            store_mismatch |= mismatches != 0;
+            report("collect", "\"series\":" + std::to_string(series) + ",\"registry\":" +
+                                  std::to_string(probe.registrySize()) + ",\"store\":" +
+                                  (options.value_store ? "true" : "false") + ",\"mismatches\":" +
+                                  std::to_string(mismatches), n, seconds);
+        }
+    }
+
+    void benchRules(MetricsModelProbe &probe)
+    {
+        if (!selected("rule_check")) return;
+        // Правила добавлены до postInit: одно на "bench_rule_counter" и rules_per_metric на "bench_rules_counter";
+        // выше порогов каждая сотая серия, стоимость — проверка, а не форматирование оповещений
+        for (auto [name, rules] : {std::pair{"bench_rule", size_t(1)}, std::pair{"bench_rules", rules_per_metric}})
+            for (size_t series : {size_t(1'000), size_t(100'000)}) {
+                if (series > options.max_series) break;
+                std::vector<std::unique_ptr<Metrics::Counter>> counters;
+                for (size_t i = 0; i < series; i++) {
+                    counters.push_back(std::make_unique<Metrics::Counter>(
+                        name, std::vector<Metrics::Tag>{{"i", std::to_string(i)}}));
+                    *counters.back() += i % 100 ? 0 : 100;
+                }
+                probe.checkRules(); // Привязка правил к сериям, дальше — только проверка
+                auto [n, seconds] = measure([&](size_t n) {
+                    for (size_t i = 0; i < n; i++) probe.checkRules();
+                }, 1);
+                report("rule_check", "\"series\":" + std::to_string(series) + ",\"rules\":" + std::to_string(rules),
+                       n * series * rules, seconds);
+            }
+    }
+
+    /// Серии bench_encode{i=...} для кодировщика и файла снимка; живут до конца замеров размера
+    std::vector<std::unique_ptr<Metrics::Counter>> makeSeries(const std::string &name, size_t series)
+    {
+        std::vector<std::unique_ptr<Metrics::Counter>> counters;
+        counters.reserve(series);
+        for (size_t i = 0; i < series; i++) {
+            counters.push_back(std::make_unique<Metrics::Counter>(
+                name, std::vector<Metrics::Tag>{{"i", std::to_string(i)}, {"dc", "eu-west"}}));
+            *counters.back() += i * 31;
+        }
+        return counters;
+    }
+
+    void benchEncoder(MetricsModelProbe &probe)
+    {
+        if (!selected("encode")) return;
+        for (size_t series : {size_t(1'000), size_t(100'000)}) {
+            if (series > options.max_series) break;
+            auto counters = makeSeries("bench_encode", series);
+            auto snapshot = probe.snapshot();
+            for (auto [format, text] : {std::pair{Metrics::TextEncoder::Format::Prometheus, "prometheus"},
+                                        std::pair{Metrics::TextEncoder::Format::OpenMetrics, "openmetrics"}}) {
+                Metrics::TextEncoder encoder(format);
+                size_t bytes = encoder.encode(*snapshot).size(); // Первый вызов заполняет кэш префиксов
+                auto [n, seconds] = measure([&](size_t n) {
+                    for (size_t i = 0; i < n; i++) bytes = encoder.encode(*snapshot).size();
+                }, 1);
+                report("encode",
+                       "\"format\":\"" + std::string(text) + "\",\"series\":" + std::to_string(series) +
+                           ",\"bytes\":" + std::to_string(bytes),
+                       n * snapshot->samples.size(), seconds);
+            }
+        }
+    }
+
+    void benchPersist(MetricsModelProbe &probe)
+    {
+        if (!selected("persist")) return;
+        auto path = (std::filesystem::temp_directory_path() / "metrics_bench.snapshot").string();
+        for (size_t series : {size_t(1'000), size_t(100'000), size_t(1'000'000)}) {
+            if (series > options.max_series) break;
+            auto counters = makeSeries("bench_persist", series);
+            auto snapshot = probe.snapshot();
+            // Каждая серия снимка ищется один раз, как при восстановлении метрик
+            std::vector<const Metrics::SeriesKey *> keys;
+            std::vector<bool> seen(snapshot->keys->size());
+            for (auto &sample : snapshot->samples)
+                if (!sample.imported && !seen[sample.id]) {
+                    seen[sample.id] = true;
+                    keys.push_back(&snapshot->key(sample));
+                }
+            auto params = "\"series\":" + std::to_string(series);
+            // Запись: сортировка, CRC, запись файла и переименование
+            auto [n, seconds] = measure([&](size_t n) {
+                for (size_t i = 0; i < n; i++) Metrics::SnapshotFile::write(path, *snapshot, {});
+            }, 1);
+            report("persist_write", params, n * series, seconds);
+            // Загрузка при старте: отображение, проверка CRC и поиск значения каждой серии
+            size_t restored = 0;
+            std::tie(n, seconds) = measure([&](size_t n) {
+                restored = 0;
+                for (size_t i = 0; i < n; i++) {
+                    Metrics::SnapshotFile file;
+                    file.open(path);
+                    for (auto key : keys) restored += file.claim(*key).has_value();
+                }
+            }, 1);
+            report("persist_reload", params, n * series, seconds);
+            if (restored != n * keys.size()) std::fprintf(stderr, "persist_reload: %zu of %zu series restored\n",
+                                                          restored, n * keys.size());
+        }
+        std::filesystem::remove(path);
+    }
+
+    void benchImport(MetricsModel &model)
+    {
+        // Установившийся режим: все серии уже в таблице, пакеты по 10k обновляют значения
+        if (!selected("import")) return;
+        for (size_t series : {size_t(100'000), size_t(1'000'000)}) {
+            if (series > options.max_series) break;
+            std::vector<Metrics::Import> batch;
+            for (size_t i = 0; i < series; i++)
+                batch.push_back({model.importKey("bench_import_" + std::to_string(series), {{"i", std::to_string(i)}}), i});
+            size_t round = 0;
+            auto [n, seconds] = measure([&](size_t n) {
+                for (size_t i = 0; i < n; i++, round++) {
+                    for (auto &import : batch) import.value = round;
+                    for (size_t from = 0; from < batch.size(); from += 10'000)
+                        model.importBatch(std::span(batch).subspan(from, std::min<size_t>(10'000, batch.size() - from)));
+                }
+            }, 1);
+            report("import", "\"series\":" + std::to_string(series) + ",\"batch\":10000", n * series, seconds);
+        }
+    }
+
+    /// Форматирование до AlertTemplate: replace_all по тексту на каждое сообщение
+    std::string formatDurationLegacy(Clock::duration d)
+    {
+        auto days = std::chrono::duration_cast<std::chrono::days>(d);
+        d -= days;
+        auto hours = std::chrono::duration_cast<std::chrono::hours>(d);
+        d -= hours;
+        auto minutes = std::chrono::duration_cast<std::chrono::minutes>(d);
+        d -= minutes;
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(d);
+        d -= seconds;
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(d);
+        std::ostringstream oss;
+        oss << std::setfill('0');
+        if (days.count() > 0) oss << days.count() << "д ";
+        if (hours.count()) oss << hours.count() << "ч ";
+        if (minutes.count()) oss << minutes.count() << "м ";
+        if (seconds.count()) oss << seconds.count() << "с ";
+        if (ms.count()) oss << ms.count() << "мс";
+        return oss.str();
+    }
+
+    std::string formatLegacy(const std::string &tmpl, const Metrics::SeriesKey &key, size_t value,
+                             Clock::duration duration)
+    {
+        std::string msg = tmpl;
+        boost::replace_all(msg, "{metric}", std::string(key.name));
+        boost::replace_all(msg, "{duration}", formatDurationLegacy(duration));
+        boost::replace_all(msg, "{value}", std::to_string(value));
+        size_t pos = msg.find("{tags}");
+        if (pos != std::string::npos) msg.replace(pos, 6, key.tags_text);
+        pos = 0;
+        while ((pos = msg.find("{tag:", pos)) != std::string::npos) {
+            size_t pos_end = msg.find("}", pos);
+            if (pos_end == std::string::npos) break;
+            std::string tag = msg.substr(pos + 5, pos_end - (pos + 5));
+            auto res = std::ranges::find_if(key.tags, [&](const Metrics::TagView &val) { return val.first == tag; });
+            if (res != key.tags.end()) {
+                msg.replace(pos, pos_end - pos + 1, res->second);
+                pos += res->second.length();
+            } else
+                pos = pos_end + 1;
+        }
+        return msg;
+    }
+
+    void benchFormat()
+    {
+        if (!selected("alert_format")) return;
+        Metrics::KeyTable keys;
+        auto id   = keys.intern("server_latency_ms", {{"host", "db-01"}, {"dc", "eu-west"}, {"role", "primary"}}).id;
+        auto &key = keys[id];
+        std::string text = "⚠️ {metric} on {tag:host} ({tag:dc}) is {value} ms for {duration} [{tags}]";
+        auto duration    = std::chrono::milliseconds(3'723'456);
+        NotifierSystem::AlertTemplate compiled;
+        compiled.compile(text);
+        if (compiled.render(key, 1234, duration) != formatLegacy(text, key, 1234, duration))
+            std::fprintf(stderr, "alert_format: template and legacy output differ\n");
+        size_t sink = 0;
+        auto [n, seconds] = measure([&](size_t n) {
+            for (size_t i = 0; i < n; i++) sink += formatLegacy(text, key, i, duration).size();
+        });
+        report("alert_format", "\"impl\":\"legacy\"", n, seconds);
+        std::string buffer;
+        std::tie(n, seconds) = measure([&](size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                buffer.clear();
+                compiled.render(buffer, key, i, duration);
+                sink += buffer.size();
+            }
+        });
+        report("alert_format", "\"impl\":\"template\"", n, seconds);
+        if (!sink) std::fprintf(stderr, "alert_format: empty output\n");
+    }
+
+    struct NullProvider : NotifierSystem::NotifierProvider {
+        void alert(const std::string &) override {}
+    };
+} // namespace
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--filter")) options.filter = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--min-ms")) options.min_ms = std::stoul(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--max-series")) options.max_series = std::stoul(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--value-store")) options.value_store = std::stoul(argv[i + 1]);
+        else {
+            std::fprintf(stderr, "usage: %s [--filter <name>] [--min-ms <ms>] [--max-series <n>] [--value-store 0|1]\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+
+    // Модель без загрузчиков и без сети; свой такт не наступает за время замеров, такты вызываются явно
+    auto model = std::make_unique<MetricsModel>();
+    MetricsModelProbe probe{*model};
+    model->init();
+    model->config.statisticInterval.value = 24 * 3600;
+    model->config.topSeriesNames.value    = 0;
+    model->config.importTtl.value         = 0;
+    model->config.valueStore.value        = options.value_store;
+    probe.addRule("bench_rule_counter", ">=50");
+    for (size_t i = 0; i < rules_per_metric; i++) probe.addRule("bench_rules_counter", ">=" + std::to_string(50 + i));
+    model->postInit();
+    NullProvider provider;
+    model->registerAlertProvider(&provider);
+
+    benchIncrements();
+    benchHistogram();
+    benchTimer();
+    benchStatic();
+    benchChurn(probe);
+    benchCollect(probe);
+    benchRules(probe);
+    benchFormat();
+    benchEncoder(probe);
+    benchPersist(probe);
+    benchImport(*model);
+
+    model->unregisterAlertProvider(&provider);
+    model.reset();
+    return store_mismatch ? 1 : 0;
+}
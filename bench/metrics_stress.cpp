@@ -0,0 +1,212 @@
+// metrics_stress: модель с быстрым тактом под параллельной нагрузкой всех публичных путей без сети.
+// Рассчитан на сборку с -fsanitize=thread; в конце печатает одну строку JSON и возвращает 1,
+// если сумма шардированного счетчика в снимке не сошлась с количеством инкрементов.
+//   metrics_stress [--seconds <с>] [--threads <потоков инкремента>]
+#include "MetricsProbe.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        size_t seconds = 10;
+        size_t threads = 4;
+    } options;
+
+    std::atomic<bool> stop = false;
+
+    struct Totals {
+        std::atomic<size_t> increments = 0, created = 0, registrations = 0, imports = 0;
+    } totals;
+
+    /// Выгрузки через upload(): копии метрик снимка читаются целиком, пока владельцы удаляют метрики
+    struct LiveUploader : Metrics::Uploader {
+        std::atomic<size_t> calls = 0, sum = 0;
+        void upload(std::set<Metrics::Metric *> &statistics) override
+        {
+            calls += !statistics.empty();
+            for (auto metric : statistics) sum += metric->value() + metric->toString(false).size();
+            // Метрика, удаляемая в io-потоке, не должна ждать обход такта, стоящего в очереди за выгрузкой
+            Metrics::Counter scratch("stress_upload_scratch");
+            scratch++;
+        }
+    };
+
+    /// Выгрузки снимков: последнее значение stress_total, по нему проверяется сумма шардов
+    struct SnapshotUploader : Metrics::Uploader {
+        explicit SnapshotUploader(size_t interval, bool changes)
+        {
+            use_snapshot = true;
+            changes_only = changes;
+            interval_ms  = interval;
+        }
+        std::atomic<size_t> calls = 0, total = 0;
+        void upload(std::set<Metrics::Metric *> &) override {}
+        void uploadSnapshot(const Metrics::Snapshot &snapshot) override
+        {
+            calls++;
+            for (auto &sample : snapshot.samples)
+                if (snapshot.key(sample).name == "stress_total_counter") total = sample.value;
+        }
+    };
+
+    struct CountingProvider : NotifierSystem::NotifierProvider {
+        std::atomic<size_t> alerts = 0;
+        void alert(const std::string &) override { alerts++; }
+    };
+
+    /// Инкременты одного общего счетчика, гистограммы и семейства из threads потоков
+    void incrementer(Metrics::Counter &total, Metrics::Histogram &latency,
+                     Metrics::MetricFamily<Metrics::Counter> &family, size_t seed)
+    {
+        std::mt19937 rnd(seed);
+        size_t local = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            for (size_t i = 0; i < 1000; i++) {
+                total++;
+                latency.record(rnd() % 100'000);
+                family.withLabels(std::to_string(rnd() % 256))++;
+            }
+            local += 1000;
+        }
+        totals.increments += local;
+    }
+
+    /// Метрики, создаваемые и удаляемые на каждом круге, с повторяющимися ключами
+    void churner(size_t seed)
+    {
+        std::mt19937 rnd(seed);
+        while (!stop.load(std::memory_order_relaxed)) {
+            std::vector<std::unique_ptr<Metrics::Counter>> counters;
+            for (size_t i = 0; i < 64; i++) {
+                std::vector<Metrics::Tag> tags = {{"peer", std::to_string(rnd() % 1024)}};
+                auto mode = i % 2 ? Metrics::Mode::Plain : Metrics::Mode::Sharded; // Plain — только из этого потока
+                counters.push_back(std::make_unique<Metrics::Counter>("stress_churn", tags, mode));
+                *counters.back() += rnd() % 3;
+                Metrics::Gauge gauge("stress_churn", tags, mode);
+                gauge++;
+                gauge--; // Gauge с ненулевым значением в деструкторе считается зависшим
+            }
+            totals.created += counters.size() * 2;
+        }
+    }
+
+    /// Загрузчики и провайдеры, снимаемые с регистрации, пока такт с ними может выполняться
+    void registrar(MetricsModel &model)
+    {
+        size_t round = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            LiveUploader live;
+            SnapshotUploader scheduled(3, round % 2);
+            CountingProvider provider;
+            model.registerUploader(&live);
+            model.registerUploader(&scheduled);
+            model.registerAlertProvider(&provider);
+            std::this_thread::sleep_for(std::chrono::milliseconds(round % 7));
+            model.unregisterAlertProvider(&provider);
+            model.unregisterUploader(&scheduled);
+            model.unregisterUploader(&live);
+            totals.registrations++;
+            round++;
+        }
+    }
+
+    /// Пакеты importBatch по растущему набору ключей
+    void importer(MetricsModel &model)
+    {
+        std::vector<Metrics::Import> batch;
+        size_t round = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            batch.clear();
+            for (size_t i = 0; i < 100; i++)
+                batch.push_back({model.importKey("stress_import", {{"i", std::to_string((round * 7 + i) % 2000)}}),
+                                 round + i});
+            model.importBatch(batch);
+            totals.imports += batch.size();
+            round++;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--seconds")) options.seconds = std::stoul(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--threads")) options.threads = std::max<size_t>(std::stoul(argv[i + 1]), 1);
+        else {
+            std::fprintf(stderr, "usage: %s [--seconds <s>] [--threads <n>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    auto model = std::make_unique<MetricsModel>();
+    MetricsModelProbe probe{*model};
+    model->init();
+    model->config.statisticIntervalMs.value = 5;
+    model->config.ioThreads.value           = 2;
+    model->config.uploaderInFlight.value    = 2;
+    model->config.historyDepth.value        = 8;
+    model->config.importTtl.value           = 2;
+    model->config.alertStateTtl.value       = 4;
+    // Правила такта модели и своей группы: привязка к появляющимся и исчезающим сериям
+    probe.addRule("stress_churn_counter", ">=1");
+    probe.addRule("stress_family_counter", "[100;1000000000]", 7);
+    model->postInit();
+
+    SnapshotUploader checker(0, false);
+    CountingProvider provider;
+    model->registerUploader(&checker);
+    model->registerAlertProvider(&provider);
+
+    size_t expected = 0;
+    auto start      = Clock::now();
+    {
+        Metrics::Counter total("stress_total", {}, Metrics::Mode::Sharded);
+        Metrics::Histogram latency("stress_latency_us", Metrics::Histogram::Buckets::logLinear(1 << 20, 1));
+        Metrics::MetricFamily<Metrics::Counter> family("stress_family", {"peer"}, 128, {}, Metrics::Mode::Sharded);
+
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < options.threads; t++)
+            workers.emplace_back(incrementer, std::ref(total), std::ref(latency), std::ref(family), t);
+        workers.emplace_back(churner, 1000);
+        workers.emplace_back(churner, 1001);
+        workers.emplace_back(registrar, std::ref(*model));
+        workers.emplace_back(importer, std::ref(*model));
+
+        std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+        stop = true;
+        for (auto &worker : workers) worker.join();
+        expected = totals.increments;
+
+        // Шарды сливаются на следующем такте; ждем снимок с полной суммой, пока счетчик еще зарегистрирован
+        auto deadline = Clock::now() + std::chrono::seconds(5);
+        while (checker.total != expected && Clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    bool total_ok = checker.total == expected;
+
+    model->unregisterAlertProvider(&provider);
+    model->unregisterUploader(&checker);
+    auto debug = model->debugDump();
+    model.reset();
+
+    std::printf("{\"stress\":\"metrics\",\"seconds\":%.3f,\"threads\":%zu,\"increments\":%zu,\"snapshot_total\":%zu,"
+                "\"total_ok\":%s,\"created\":%zu,\"registrations\":%zu,\"imports\":%zu,\"snapshots\":%zu,"
+                "\"alerts\":%zu}\n",
+                seconds, options.threads, expected, size_t(checker.total), total_ok ? "true" : "false",
+                size_t(totals.created), size_t(totals.registrations), size_t(totals.imports), size_t(checker.calls),
+                size_t(provider.alerts));
+    if (!debug.empty()) std::fprintf(stderr, "%s", debug.c_str());
+    return total_ok ? 0 : 1;
+}
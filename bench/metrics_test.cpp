@@ -0,0 +1,356 @@
+// metrics_test: проверки поведения модели без сети, по строке JSON на проверку; хранилище значений включено.
+// Возвращает 1, если хотя бы одна проверка не прошла; первое расхождение печатается в stderr.
+//   metrics_test [--filter <подстрока>]
+#include "MetricsProbe.hpp"
+#include <MetricsModel/AlertTemplate>
+#include <MetricsModel/ConditionBatch>
+#include <MetricsModel/MetricsScheduler>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    std::string filter;
+    bool failed = false;
+
+    /// Проверка пишет в error первое расхождение; пустой error — проверка прошла
+    template <class Check> void run(const char *test, Check &&check)
+    {
+        if (std::string(test).find(filter) == std::string::npos) return;
+        std::ostringstream error;
+        check(error);
+        auto text = error.str();
+        std::printf("{\"test\":\"%s\",\"ok\":%s}\n", test, text.empty() ? "true" : "false");
+        std::fflush(stdout);
+        if (!text.empty()) std::fprintf(stderr, "%s: %s\n", test, text.c_str());
+        failed |= !text.empty();
+    }
+
+    size_t seriesOf(MetricsModel &model, const std::string &name)
+    {
+        for (auto &[series, count] : model.seriesPerName())
+            if (series == name) return count;
+        return 0;
+    }
+
+    constexpr size_t per_name = 10; /// maxSeriesPerName модели проверок
+
+    /// Серии удаленных метрик и истекших импортов выходят из бюджетов: новые теги снова получают свои серии
+    void seriesBudgetChurn(MetricsModel &model, MetricsModelProbe &probe, std::ostream &error)
+    {
+        for (size_t round = 0; round < 5 && error.tellp() == 0; round++) {
+            std::vector<std::unique_ptr<Metrics::Counter>> counters;
+            for (size_t i = 0; i < per_name; i++)
+                counters.push_back(std::make_unique<Metrics::Counter>(
+                    "test_budget", std::vector<Metrics::Tag>{{"user", std::to_string(round * per_name + i)}}));
+            if (seriesOf(model, "test_budget_counter") != per_name)
+                error << "round " << round << ": " << seriesOf(model, "test_budget_counter") << " series of "
+                      << per_name;
+        }
+        if (error.tellp() == 0 && seriesOf(model, "test_budget_counter") != 0)
+            error << "after churn: " << seriesOf(model, "test_budget_counter") << " series";
+
+        for (size_t round = 0; round < 3 && error.tellp() == 0; round++) {
+            std::vector<Metrics::Import> batch;
+            for (size_t i = 0; i < per_name; i++) {
+                auto id = model.importKey("test_import", {{"peer", std::to_string(round * per_name + i)}});
+                if (id == Metrics::KeyTable::no_id) {
+                    error << "import round " << round << ": key " << i << " over budget";
+                    break;
+                }
+                batch.push_back({id, i});
+            }
+            model.importBatch(batch);
+            if (error.tellp() == 0 && seriesOf(model, "test_import") != per_name)
+                error << "import round " << round << ": " << seriesOf(model, "test_import") << " series";
+            // importTtl = 1: запись без обновления удаляется на втором такте
+            probe.tick();
+            probe.tick();
+        }
+        if (error.tellp() == 0 && seriesOf(model, "test_import") != 0)
+            error << "after import expiry: " << seriesOf(model, "test_import") << " series";
+
+        // Сверх бюджета — в серию __overflow__ модели, она остается в счете имени
+        std::vector<std::unique_ptr<Metrics::Counter>> counters;
+        for (size_t i = 0; i <= per_name; i++)
+            counters.push_back(std::make_unique<Metrics::Counter>(
+                "test_budget", std::vector<Metrics::Tag>{{"user", "last" + std::to_string(i)}}));
+        if (error.tellp() == 0 && seriesOf(model, "test_budget_counter") != per_name + 1)
+            error << "over budget: " << seriesOf(model, "test_budget_counter") << " series, expected "
+                  << per_name << " and overflow";
+    }
+
+    /// Метрики всех видов, созданные на слотах удаленных: значения ValueStore совпадают с обходом объектов Metric
+    void valueStoreChurn(MetricsModelProbe &probe, std::ostream &error)
+    {
+        std::vector<std::unique_ptr<Metrics::Counter>> counters;
+        std::vector<std::unique_ptr<Metrics::Gauge>> gauges;
+        for (size_t round = 0; round < 4 && error.tellp() == 0; round++) {
+            // Каждая вторая метрика прошлого круга удаляется, ее слот занимает метрика этого круга
+            for (size_t i = 0; i < counters.size(); i += 2) counters[i].reset();
+            for (size_t i = 0; i < gauges.size(); i += 2) {
+                *gauges[i] = 0;
+                gauges[i].reset();
+            }
+            std::erase(counters, nullptr);
+            std::erase(gauges, nullptr);
+            // Не больше per_name серий на имя, метрики одной серии делят series_id
+            for (size_t i = 0; i < 200; i++) {
+                std::vector<Metrics::Tag> tags = {{"i", std::to_string(i % per_name)}};
+                counters.push_back(std::make_unique<Metrics::Counter>(
+                    "test_store", tags, i % 3 ? Metrics::Mode::Plain : Metrics::Mode::Sharded));
+                *counters.back() += round * 1000 + i;
+                gauges.push_back(std::make_unique<Metrics::Gauge>("test_store", tags));
+                *gauges.back() += i;
+            }
+            Metrics::Bool flag("test_store_flag", {{"round", std::to_string(round)}});
+            flag = round % 2;
+            Metrics::Histogram latency("test_store_latency", Metrics::Histogram::Buckets::linear(0, 100, 5));
+            for (size_t i = 0; i < 100; i++) latency.record(i * round);
+            probe.tick();
+            if (auto mismatches = probe.storeMismatches())
+                error << "round " << round << ": " << mismatches << " values differ from the registry walk";
+        }
+        for (auto &gauge : gauges) *gauge = 0;
+    }
+
+    /// Провайдер, который из alert() в потоке io_context снимает с регистрации другой провайдер и себя
+    struct UnregisteringProvider : NotifierSystem::NotifierProvider {
+        UnregisteringProvider(MetricsModel &model, NotifierSystem::NotifierProvider &other)
+            : model(model), other(other)
+        {
+        }
+        MetricsModel &model;
+        NotifierSystem::NotifierProvider &other;
+        std::atomic<bool> called = false;
+        std::promise<void> done;
+        void alert(const std::string &) override
+        {
+            if (called.exchange(true)) return;
+            model.unregisterAlertProvider(&other);
+            model.unregisterAlertProvider(this);
+            done.set_value();
+        }
+    };
+
+    struct IdleProvider : NotifierSystem::NotifierProvider {
+        void alert(const std::string &) override {}
+    };
+
+    /// Снятие провайдеров из io-потока не ждет обработчиков strand, которые этот поток еще не выполнил
+    void unregisterFromAlert(MetricsModel &model, MetricsModelProbe &probe, std::ostream &error)
+    {
+        // Переживают модель: alert() еще выполняется, когда done уже выставлен
+        static IdleProvider other;
+        static UnregisteringProvider self(model, other);
+        auto done = self.done.get_future();
+        model.registerAlertProvider(&other);
+        model.registerAlertProvider(&self);
+        Metrics::Counter counter("test_unregister");
+        counter++;
+        probe.tick();
+        if (done.wait_for(std::chrono::seconds(10)) != std::future_status::ready)
+            error << "unregisterAlertProvider called from alert() did not return in 10 s";
+    }
+
+    /// Шаблоны с вложенными и незакрытыми скобками: поиск продолжается за концом подстановки, а не внутри нее
+    void alertTemplateBraces(std::ostream &error)
+    {
+        Metrics::KeyTable keys;
+        auto &key = keys[keys.intern("m", {{"host", "h1"}, {"dc", "eu"}}).id];
+        std::pair<const char *, const char *> cases[] = {
+            {"{tag:x{metric}} end", "{tag:xm} end"},
+            {"{tag:{tag:host}}", "{tag:h1}"},
+            {"{{metric}}", "{m}"},
+            {"{metric}{value}{metric}", "m7m"},
+            {"a {tag:dc}{tag:host}} {", "a euh1} {"},
+            {"{tag:host", "{tag:host"},
+            {"{tag:host {value}", "{tag:host 7"},
+            {"{metric", "{metric"},
+            {"{tag:} {tag:nope} {tag:host}", "{tag:} {tag:nope} h1"},
+            {"{tags}}{", "dc=eu,host=h1}{"},
+        };
+        for (auto [text, expected] : cases) {
+            NotifierSystem::AlertTemplate compiled;
+            compiled.compile(text);
+            auto rendered = compiled.render(key, 7);
+            if (rendered == expected) continue;
+            error << "\"" << text << "\" rendered \"" << rendered << "\", expected \"" << expected << "\"";
+            break;
+        }
+    }
+
+    /// Тексты оповещений, полученные провайдером
+    struct RecordingProvider : NotifierSystem::NotifierProvider {
+        std::mutex mutex;
+        std::string texts;
+        void alert(const std::string &text) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            texts += text + '\n';
+        }
+        bool received(std::string_view part)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return texts.find(part) != std::string::npos;
+        }
+    };
+
+    /// Группа правил со своим интервалом без такта модели видит значения шардированного счетчика и корзин
+    /// гистограммы: она собирает свои серии сама, для серии корзины — саму гистограмму
+    void groupCollect(MetricsModel &model, std::ostream &error)
+    {
+        RecordingProvider provider;
+        model.registerAlertProvider(&provider);
+        {
+            Metrics::Counter counter("test_group", {}, Metrics::Mode::Sharded);
+            Metrics::Histogram latency("test_group_latency", Metrics::Histogram::Buckets::linear(0, 10, 2));
+            counter += 5;
+            for (size_t i = 0; i < 3; i++) latency.record(100);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            for (auto series : {"test_group_counter:5", "test_group_latency_histogram_bucket:3"})
+                while (!provider.received(series)) {
+                    if (std::chrono::steady_clock::now() > deadline) {
+                        error << "no alert for " << series << " from the 10 ms rule group in 5 s";
+                        break;
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+        }
+        model.unregisterAlertProvider(&provider);
+    }
+
+    /// Такт, который только отправляет работу в io-поток, стоит столько, сколько идет эта работа: расписание
+    /// с tickBudgetPercent замедляется
+    void schedulerPostedCost(std::ostream &error)
+    {
+        boost::asio::io_context io;
+        auto guard = boost::asio::make_work_guard(io);
+        Metrics::Scheduler scheduler(io);
+        std::thread thread([&] { io.run(); });
+        std::atomic<size_t> slowest = 0;
+        scheduler.add("test_posted", {std::chrono::milliseconds(10), 50, 8},
+                      [&](std::chrono::milliseconds period, const Metrics::Scheduler::Pending &pending) {
+                          slowest = std::max<size_t>(slowest, period.count());
+                          boost::asio::post(io, [pending] { std::this_thread::sleep_for(std::chrono::milliseconds(8)); });
+                          return true;
+                      });
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        scheduler.stop();
+        guard.reset();
+        thread.join();
+        if (slowest <= 10) error << "period stayed at " << slowest << " ms with 8 ms of posted work per 10 ms tick";
+    }
+
+    /// ConditionBatch на каждом доступном процессору наборе инструкций против Condition::check: значения на краях
+    /// отрезков, 0, 2^63 и SIZE_MAX, условия с != и с числом отрезков больше двух, в том числе случайные
+    void conditionBatchDifferential(std::ostream &error)
+    {
+        const char *texts[] = {">=0", ">0", "<1", "=0", "!=0", "<=0", "!=9223372036854775808", ">=9223372036854775808",
+                               "<9223372036854775808", "=18446744073709551615", "!=18446744073709551615",
+                               ">=18446744073709551615", "<18446744073709551615", "[10;20]",
+                               "[10;20] || [30;40] || >=100", "<5 || [10;20] || [30;40] || >100", "!=5 && !=10",
+                               "!=0 && !=9223372036854775808 && !=18446744073709551615",
+                               ">=9223372036854775807 && <=9223372036854775809"};
+        std::vector<std::unique_ptr<NotifierSystem::Notify>> rules;
+        for (auto text : texts) {
+            rules.push_back(std::make_unique<NotifierSystem::Notify>());
+            rules.back()->condition.text.value = text;
+            rules.back()->condition.init();
+            if (rules.back()->condition.type == NotifierSystem::ConditionType::Error) error << text << " does not parse";
+        }
+        constexpr size_t top = SIZE_MAX, half = size_t(1) << 63;
+        std::vector<size_t> edges = {0, 1, 2, half - 1, half, half + 1, top - 1, top};
+        std::mt19937_64 rnd(15);
+        for (size_t i = 0; i < 64; i++) {
+            rules.push_back(std::make_unique<NotifierSystem::Notify>());
+            auto &intervals = rules.back()->condition.intervals;
+            for (size_t n = 1 + rnd() % 5; n; n--) {
+                auto end = [&] { return rnd() % 2 ? edges[rnd() % edges.size()] : size_t(rnd()); };
+                size_t a = end(), b = end();
+                intervals.emplace_back(std::min(a, b), std::max(a, b));
+            }
+        }
+        if (std::ranges::none_of(rules, [](auto &rule) { return rule->condition.intervals.size() > 2; }))
+            error << "no condition with more than two intervals";
+
+        // Полоса на каждую пару (условие, значение): края пула и края отрезков условия
+        NotifierSystem::ConditionBatch batch;
+        std::vector<std::pair<const NotifierSystem::Condition *, size_t>> lanes;
+        for (auto &rule : rules) {
+            auto values = edges;
+            for (auto [lo, hi] : rule->condition.intervals)
+                for (size_t v : {lo - 1, lo, lo + 1, hi - 1, hi, hi + 1}) values.push_back(v);
+            for (auto v : values) {
+                batch.add(rule->condition.intervals);
+                lanes.emplace_back(&rule->condition, v);
+            }
+        }
+        for (size_t lane = 0; lane < lanes.size(); lane++) batch.values()[lane] = lanes[lane].second;
+
+        using Isa = NotifierSystem::ConditionBatch::Isa;
+        std::vector<uint64_t> mask(batch.words());
+        for (auto isa : {Isa::Scalar, Isa::SSE42, Isa::AVX2}) {
+            if (isa > NotifierSystem::ConditionBatch::best() || error.tellp() != 0) continue;
+            batch.evaluate(mask, isa);
+            for (size_t lane = 0; lane < lanes.size(); lane++) {
+                auto [condition, value] = lanes[lane];
+                bool hit = mask[lane / 64] >> (lane % 64) & 1;
+                if (hit == condition->check(value)) continue;
+                error << NotifierSystem::ConditionBatch::name(isa) << ": value " << value << " intervals";
+                for (auto [lo, hi] : condition->intervals) error << " [" << lo << ";" << hi << "]";
+                error << " batch " << hit;
+                break;
+            }
+        }
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--filter")) filter = argv[i + 1];
+        else {
+            std::fprintf(stderr, "usage: %s [--filter <name>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // Такты только явные, как в metrics_bench
+    auto model = std::make_unique<MetricsModel>();
+    MetricsModelProbe probe{*model};
+    model->init();
+    model->config.statisticInterval.value = 24 * 3600;
+    model->config.maxSeriesPerName.value  = per_name;
+    model->config.importTtl.value         = 1;
+    model->config.topSeriesNames.value    = 0;
+    model->config.valueStore.value        = true;
+    probe.addRule("test_unregister_counter", ">=1");
+    probe.addRule("test_group_counter", ">=5", 10);
+    probe.addRule("test_group_latency_histogram_bucket", ">=3", 10);
+    model->postInit();
+
+    run("series_budget_churn", [&](std::ostream &error) { seriesBudgetChurn(*model, probe, error); });
+    run("value_store_churn", [&](std::ostream &error) { valueStoreChurn(probe, error); });
+    run("condition_batch_differential", conditionBatchDifferential);
+    run("alert_template_braces", alertTemplateBraces);
+    run("group_collect", [&](std::ostream &error) { groupCollect(*model, error); });
+    run("scheduler_posted_cost", schedulerPostedCost);
+    run("unregister_from_alert", [&](std::ostream &error) { unregisterFromAlert(*model, probe, error); });
+
+    model.reset();
+    return failed ? 1 : 0;
+}
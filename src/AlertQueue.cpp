@@ -0,0 +1,139 @@
+#include "AlertQueue.hpp"
+#include "NotifierSystem.hpp"
+#include <PluginCore/Logger/Log>
+#include <boost/asio/post.hpp>
+#include <boost/core/demangle.hpp>
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+
+namespace NotifierSystem
+{
+
+    AlertQueue::AlertQueue(NotifierProvider *provider, boost::asio::io_context &io, Limits limits)
+        : provider_(provider), limits_(limits), strand_(boost::asio::make_strand(io)), timer_(strand_),
+          tokens_(limits.rate_per_minute), refilled_(std::chrono::steady_clock::now())
+    {
+        std::vector<Metrics::Tag> tags = {{"provider", boost::core::demangle(typeid(*provider).name())}};
+        depth_      = std::make_unique<Metrics::Gauge>("MetricsModel_alert_queue", tags, Metrics::Mode::Sharded);
+        latency_us_ = std::make_unique<Metrics::Gauge>("MetricsModel_alert_latency_us", tags, Metrics::Mode::Sharded);
+        sent_       = std::make_unique<Metrics::Counter>("MetricsModel_alert_sent", tags, Metrics::Mode::Sharded);
+        dropped_    = std::make_unique<Metrics::Counter>("MetricsModel_alert_dropped", tags, Metrics::Mode::Sharded);
+        deduped_    = std::make_unique<Metrics::Counter>("MetricsModel_alert_deduped", tags, Metrics::Mode::Sharded);
+    }
+
+    AlertQueue::~AlertQueue()
+    {
+        *depth_      = 0;
+        *latency_us_ = 0;
+    }
+
+    void AlertQueue::push(const std::vector<std::string> &texts)
+    {
+        if (texts.empty() || closed_) return;
+        std::vector<std::pair<const std::string *, size_t>> lines; // (текст, повторов)
+        std::unordered_map<std::string_view, size_t> index;
+        for (auto &text : texts) {
+            auto [it, inserted] = index.try_emplace(text, lines.size());
+            if (inserted) lines.emplace_back(&text, 1);
+            else lines[it->second].second++;
+        }
+        size_t deduped = texts.size() - lines.size(), dropped = 0;
+        auto batch     = std::max<size_t>(limits_.batch, 1);
+        std::vector<std::string> messages;
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (i % batch == 0) messages.emplace_back();
+            else messages.back() += '\n';
+            messages.back() += *lines[i].first;
+            if (lines[i].second > 1) messages.back() += " (x" + std::to_string(lines[i].second) + ")";
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) return;
+        for (auto &text : messages) {
+            if (std::any_of(pending_.begin(), pending_.end(), [&](auto &message) { return message.text == text; }))
+                deduped++;
+            else if (pending_.size() >= limits_.capacity)
+                dropped++;
+            else
+                pending_.push_back({std::move(text), now});
+        }
+        if (deduped) *deduped_ += deduped;
+        if (dropped) *dropped_ += dropped;
+        *depth_ = pending_.size();
+        if (scheduled_ || pending_.empty()) return;
+        scheduled_ = true;
+        boost::asio::post(strand_, [self = shared_from_this()] { self->pump(); });
+    }
+
+    bool AlertQueue::take()
+    {
+        if (!limits_.rate_per_minute) return true;
+        auto now   = std::chrono::steady_clock::now();
+        auto rate  = limits_.rate_per_minute / 60.0; // токенов в секунду, запас не больше минутной нормы
+        tokens_    = std::min<double>(limits_.rate_per_minute,
+                                      tokens_ + std::chrono::duration<double>(now - refilled_).count() * rate);
+        refilled_  = now;
+        if (tokens_ < 1) return false;
+        tokens_ -= 1;
+        return true;
+    }
+
+    void AlertQueue::pump()
+    {
+        Message message;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_ || pending_.empty()) {
+                scheduled_ = false;
+                return;
+            }
+            if (!take()) {
+                // scheduled_ остается выставленным: очередь продолжит таймер, а не push
+                auto wait = std::chrono::duration<double>((1 - tokens_) * 60 / limits_.rate_per_minute);
+                timer_.expires_after(std::chrono::duration_cast<std::chrono::steady_clock::duration>(wait));
+                timer_.async_wait([self = shared_from_this()](const boost::system::error_code &ec) {
+                    if (!ec) self->pump();
+                });
+                return;
+            }
+            message = std::move(pending_.front());
+            pending_.pop_front();
+            *depth_ = pending_.size();
+            sender_ = std::this_thread::get_id();
+        }
+        try {
+            METRICS_INSTRUMENT(std::optional<Metrics::ScopedTimer<Metrics::Histogram>> timer;
+                               if (call_us) timer.emplace(*call_us);)
+            provider_->alert(message.text);
+            (*sent_)++;
+        } catch (std::exception &e) {
+            R_LOG(1, "Exception throwed in alert provider: " << e.what());
+        }
+        auto elapsed = std::chrono::steady_clock::now() - message.queued;
+        *latency_us_ = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sender_ = {};
+            if (!closed_ && !pending_.empty())
+                boost::asio::post(strand_, [self = shared_from_this()] { self->pump(); });
+            else
+                scheduled_ = false;
+        }
+        idle_.notify_all();
+    }
+
+    void AlertQueue::close()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        closed_ = true;
+        if (!pending_.empty()) *dropped_ += pending_.size();
+        pending_.clear();
+        *depth_ = 0;
+        boost::asio::post(strand_, [self = shared_from_this()] { self->timer_.cancel(); });
+        // Провайдер будет удален сразу после выхода: ждем alert(), который уже идет в другом потоке
+        if (sender_ != std::this_thread::get_id()) idle_.wait(lock, [this] { return sender_ == std::thread::id(); });
+    }
+
+} // namespace NotifierSystem
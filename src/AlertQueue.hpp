@@ -0,0 +1,80 @@
+#pragma once
+#include "Metrics.hpp"
+#include "MetricsInstrumentation.hpp"
+#include <atomic>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace NotifierSystem
+{
+
+    class NotifierProvider;
+
+    /// Очередь доставки сообщений одному провайдеру оповещений. Провайдер вызывается в своем strand,
+    /// поэтому медленная отправка не задерживает NotifyManager и других провайдеров. Оповещения одного такта
+    /// сводятся в одно сообщение, одинаковые тексты — в одну строку с количеством. Сообщение, такое же как уже
+    /// ожидающее в очереди, и сообщения сверх capacity отбрасываются, отправка ограничивается rate_per_minute.
+    class AlertQueue : public std::enable_shared_from_this<AlertQueue>
+    {
+    public:
+        struct Limits {
+            size_t capacity        = 100; /// Сообщений в очереди
+            size_t batch           = 50;  /// Оповещений в одном сообщении
+            size_t rate_per_minute = 0;   /// 0 — без ограничения
+        };
+
+        AlertQueue(NotifierProvider *provider, boost::asio::io_context &io, Limits limits);
+        ~AlertQueue();
+
+        /// Тексты одного такта, из strand NotifyManager
+        void push(const std::vector<std::string> &texts);
+        /// Отбрасывает очередь и ждет только уже идущий alert(): после возврата провайдер больше не вызывается.
+        /// Обработчики, еще стоящие в strand, не ждутся, поэтому вызов безопасен и из потоков io_context.
+        /// Из alert() самого провайдера не ждет ничего, провайдер не должен удаляться до выхода из alert()
+        void close();
+
+        /// Время вызова alert(), задается до первого push
+        METRICS_INSTRUMENT(Metrics::Histogram *call_us = nullptr;)
+
+    private:
+        struct Message {
+            std::string text;
+            std::chrono::steady_clock::time_point queued;
+        };
+
+        /// Одно сообщение за обработчик strand, следующее — новым обработчиком: отправка длинной очереди
+        /// не занимает поток io_context надолго
+        void pump();
+        bool take(); /// Токен ограничения скорости, под mutex_
+
+        NotifierProvider *provider_;
+        Limits limits_;
+        boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+        boost::asio::steady_timer timer_; /// Ожидание токена, только из strand_
+
+        std::mutex mutex_;
+        std::deque<Message> pending_;
+        bool scheduled_ = false; /// pump отправлен в strand или ждет токена
+        double tokens_  = 0;
+        std::chrono::steady_clock::time_point refilled_;
+        std::atomic<bool> closed_ = false;
+        std::thread::id sender_;     /// Поток, в котором идет alert(), пусто — отправки нет; под mutex_
+        std::condition_variable idle_; /// sender_ сброшен, его ждет close()
+
+        std::unique_ptr<Metrics::Gauge> depth_;      /// Сообщений в очереди
+        std::unique_ptr<Metrics::Gauge> latency_us_; /// От постановки в очередь до возврата из alert()
+        std::unique_ptr<Metrics::Counter> sent_;
+        std::unique_ptr<Metrics::Counter> dropped_;  /// Сверх capacity и оставшиеся при close()
+        std::unique_ptr<Metrics::Counter> deduped_;  /// Повторы текста в такте и в очереди
+    };
+
+} // namespace NotifierSystem
@@ -0,0 +1,80 @@
+#include "AlertStateTable.hpp"
+#include <algorithm>
+#include <bit>
+
+namespace NotifierSystem
+{
+
+    void AlertStateTable::rehash(size_t capacity)
+    {
+        auto old = std::move(entries_);
+        entries_.assign(capacity, Entry{});
+        shift_ = 64 - std::countr_zero(capacity);
+        tombs_ = 0;
+        for (auto &entry : old) {
+            if (entry.id >= tomb) continue;
+            auto i = home(entry.id);
+            while (entries_[i].id != empty) i = (i + 1) & (capacity - 1);
+            entries_[i] = entry;
+        }
+    }
+
+    AlertState *AlertStateTable::find(uint32_t series_id)
+    {
+        if (entries_.empty()) return nullptr;
+        auto mask = entries_.size() - 1;
+        for (auto i = home(series_id); entries_[i].id != empty; i = (i + 1) & mask)
+            if (entries_[i].id == series_id) return &entries_[i].state;
+        return nullptr;
+    }
+
+    std::pair<AlertState *, AlertStateTable::Bind> AlertStateTable::bind(uint32_t series_id, uint32_t round)
+    {
+        // Заполнение вместе с удаленными не больше 3/4: цепочки пробирования остаются короткими.
+        // Пока живых не больше 5/8, таблица только очищается от удаленных
+        if ((size_ + tombs_ + 1) * 4 > entries_.size() * 3)
+            rehash(std::max(min_capacity, (size_ + 1) * 8 > entries_.size() * 5 ? entries_.size() * 2 : entries_.size()));
+        auto mask   = entries_.size() - 1;
+        Entry *free = nullptr;
+        auto i      = home(series_id);
+        for (; entries_[i].id != empty; i = (i + 1) & mask) {
+            auto &entry = entries_[i];
+            if (entry.id == tomb) {
+                if (!free) free = &entry;
+                continue;
+            }
+            if (entry.id != series_id) continue;
+            if (entry.round == round && entry.gone == live) return {&entry.state, Bind::Repeated};
+            entry.round = round;
+            entry.gone  = live;
+            return {&entry.state, Bind::Existing};
+        }
+        if (free) tombs_--;
+        else free = &entries_[i];
+        *free = {series_id, round, live, {}};
+        size_++;
+        return {&free->state, Bind::New};
+    }
+
+    size_t AlertStateTable::expire(uint32_t round, uint32_t tick, uint32_t ttl)
+    {
+        size_t removed = 0, waiting = 0;
+        for (auto &entry : entries_) {
+            if (entry.id >= tomb || entry.round == round) continue;
+            if (entry.gone == live) entry.gone = tick;
+            if (tick - entry.gone < ttl) {
+                waiting++;
+                continue;
+            }
+            entry.id = tomb;
+            removed++;
+        }
+        size_ -= removed;
+        tombs_ += removed;
+        auto capacity = entries_.size();
+        while (capacity > min_capacity && size_ * 8 < capacity) capacity /= 2;
+        if (capacity != entries_.size() || tombs_ * 8 > entries_.size()) rehash(capacity);
+        return waiting;
+    }
+
+} // namespace NotifierSystem
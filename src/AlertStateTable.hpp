@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace NotifierSystem
+{
+
+    /// Состояние пары (серия, правило)
+    struct AlertState {
+        uint64_t window  = 0;     /// Результаты последних 64 проверок, младший бит — последняя
+        size_t value     = 0;     /// Значение метрики при последнем срабатывании, для отчета
+        uint32_t current = 0;     /// Срабатывания подряд
+        uint32_t total   = 0;     /// Срабатывания за период отчета
+        bool firing      = false; /// Оповещение о начале отправлено
+    };
+
+    /// Состояния оповещений одного правила по series_id: открытая адресация с линейным пробированием
+    /// в одном массиве, поиск O(1) без выделения памяти на серию. Ключ — серия, а не объект Metric, поэтому
+    /// метрика, пересозданная с тем же именем и тегами, продолжает свое состояние. Серия, пропавшая из реестра,
+    /// удаляется через ttl тактов: запись помечается удаленной и переиспользуется, таблица перестраивается,
+    /// когда удаленных много или заполнено меньше 1/8. Указатели на состояния действительны до следующего
+    /// bind или expire. Только из strand NotifyManager.
+    class AlertStateTable
+    {
+    public:
+        enum class Bind {
+            New,      /// Состояние создано
+            Existing, /// Состояние серии уже было
+            Repeated  /// Серия уже привязана на этом проходе: вторая метрика с тем же ключом
+        };
+
+        /// Отмечает серию привязанной на проходе round
+        std::pair<AlertState *, Bind> bind(uint32_t series_id, uint32_t round);
+        /// Серия, не привязанная на проходе round, удаляется, если пропала не меньше ttl тактов назад
+        /// Возвращает количество пропавших серий, срок которых еще не истек
+        size_t expire(uint32_t round, uint32_t tick, uint32_t ttl);
+        AlertState *find(uint32_t series_id);
+
+        /// f(series_id, state) по всем состояниям
+        template <class F> void forEach(F &&f)
+        {
+            for (auto &entry : entries_)
+                if (entry.id < tomb) f(entry.id, entry.state);
+        }
+
+        size_t size() const { return size_; }
+        size_t bytes() const { return entries_.capacity() * sizeof(Entry); }
+
+    private:
+        static constexpr uint32_t empty      = UINT32_MAX;
+        static constexpr uint32_t tomb       = UINT32_MAX - 1; /// Удаленная запись, пробирование идет дальше
+        static constexpr uint32_t live       = UINT32_MAX;
+        static constexpr size_t min_capacity = 16;
+
+        struct Entry {
+            uint32_t id    = empty;
+            uint32_t round = 0;    /// Последний проход bind, на котором серия была в реестре
+            uint32_t gone  = live; /// Такт, на котором серию впервые не нашли
+            AlertState state;
+        };
+
+        size_t home(uint32_t id) const { return (uint64_t(id) * 0x9E3779B97F4A7C15ull) >> shift_; }
+        void rehash(size_t capacity);
+
+        std::vector<Entry> entries_; /// Размер — степень двойки или 0
+        size_t size_  = 0;
+        size_t tombs_ = 0;
+        int shift_    = 64;
+    };
+
+} // namespace NotifierSystem
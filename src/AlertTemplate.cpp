@@ -0,0 +1,118 @@
+#include "AlertTemplate.hpp"
+#include <charconv>
+
+namespace NotifierSystem
+{
+
+    namespace
+    {
+        void appendNumber(std::string &out, uint64_t value)
+        {
+            char buf[20];
+            auto end = std::to_chars(buf, buf + sizeof(buf), value).ptr;
+            out.append(buf, end);
+        }
+    } // namespace
+
+    void AlertTemplate::compile(std::string text)
+    {
+        text_ = std::move(text);
+        tokens_.clear();
+        keys_.clear();
+        literal_size_ = 0;
+        duration_     = false;
+        std::string_view view(text_);
+        size_t literal = 0; // Начало текущего литерала
+        auto flush     = [&](size_t end) {
+            if (end == literal) return;
+            tokens_.push_back({Kind::Literal, uint32_t(literal), uint32_t(end - literal)});
+            literal_size_ += end - literal;
+        };
+        // pos — начало следующего поиска '{': после подстановки поиск продолжается за ней, а не внутри
+        for (size_t pos = view.find('{'); pos != std::string_view::npos; pos = view.find('{', pos)) {
+            static constexpr std::pair<std::string_view, Kind> fixed[] = {{"{metric}", Kind::Metric},
+                                                                          {"{value}", Kind::Value},
+                                                                          {"{duration}", Kind::Duration},
+                                                                          {"{tags}", Kind::Tags}};
+            auto rest    = view.substr(pos);
+            bool matched = false;
+            for (auto [name, kind] : fixed)
+                if (rest.starts_with(name)) {
+                    flush(pos);
+                    tokens_.push_back({kind});
+                    duration_ |= kind == Kind::Duration;
+                    literal = pos + name.size();
+                    matched = true;
+                    break;
+                }
+            if (matched) {
+                pos = literal;
+                continue;
+            }
+            // Ключ тега — до '}' без '{' внутри: в "{tag:x{metric}}" текстом остается "{tag:x", {metric}
+            // подставляется. Незакрытый {tag: остается текстом
+            auto end = rest.starts_with("{tag:") ? view.find_first_of("{}", pos + 5) : std::string_view::npos;
+            if (end == std::string_view::npos || view[end] == '{') {
+                pos++;
+                continue;
+            }
+            flush(pos);
+            tokens_.push_back({Kind::Tag, uint32_t(keys_.size()), uint32_t(end + 1 - pos)});
+            keys_.push_back({uint32_t(pos + 5), uint32_t(end - pos - 5)});
+            literal = pos = end + 1;
+        }
+        flush(view.size());
+    }
+
+    const Metrics::TagView *AlertTemplate::find(const TagKey &tag, const Metrics::SeriesKey &key) const
+    {
+        std::string_view name(text_.data() + tag.offset, tag.size);
+        // У серий одного правила обычно одинаковый набор тегов: позиция с прошлой серии почти всегда верна
+        if (tag.hint < key.tags.size() && key.tags[tag.hint].first == name) return &key.tags[tag.hint];
+        for (uint32_t i = 0; i < key.tags.size(); i++)
+            if (key.tags[i].first == name) {
+                tag.hint = i;
+                return &key.tags[i];
+            }
+        return nullptr;
+    }
+
+    void AlertTemplate::render(std::string &out, const Metrics::SeriesKey &key, size_t value,
+                               Clock::duration duration) const
+    {
+        out.reserve(out.size() + literal_size_ + key.name.size() + key.tags_text.size() + 20);
+        for (auto &token : tokens_) {
+            switch (token.kind) {
+                case Kind::Literal: out.append(text_, token.offset, token.size); break;
+                case Kind::Metric: out.append(key.name); break;
+                case Kind::Value: appendNumber(out, value); break;
+                case Kind::Duration: appendDuration(out, duration); break;
+                case Kind::Tags: out.append(key.tags_text); break;
+                case Kind::Tag: {
+                    auto &tag = keys_[token.offset];
+                    if (auto found = find(tag, key)) out.append(found->second);
+                    else out.append(text_, tag.offset - 5, token.size); // Тега нет у серии: остается текстом
+                    break;
+                }
+            }
+        }
+    }
+
+    void AlertTemplate::appendDuration(std::string &out, Clock::duration d)
+    {
+        using namespace std::chrono;
+        auto part = [&](auto unit, const char *suffix) {
+            auto count = duration_cast<decltype(unit)>(d);
+            d -= count;
+            if (count.count() <= 0) return;
+            appendNumber(out, count.count());
+            out += suffix;
+        };
+        part(days{}, "д ");
+        part(hours{}, "ч ");
+        part(minutes{}, "м ");
+        part(seconds{}, "с ");
+        part(milliseconds{}, "мс");
+    }
+
+} // namespace NotifierSystem
@@ -0,0 +1,57 @@
+#pragma once
+#include "SeriesKeys.hpp"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace NotifierSystem
+{
+
+    /// Текст оповещения, разобранный один раз: литералы и подстановки {metric}, {value}, {duration}, {tags}
+    /// и {tag:key}. render дописывает сообщение в буфер вызывающего одним проходом, без поиска по тексту.
+    /// Ключ {tag:key} сводится к номеру в keys_; позиция тега в отсортированных тегах серии запоминается
+    /// и проверяется одним сравнением. Нераспознанная подстановка или тег, которого нет у серии, остаются текстом.
+    class AlertTemplate
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        void compile(std::string text);
+        const std::string &text() const { return text_; }
+        bool hasDuration() const { return duration_; }
+
+        /// Дописывает сообщение в out; duration — время с начала срабатывания, нужна только при hasDuration()
+        void render(std::string &out, const Metrics::SeriesKey &key, size_t value, Clock::duration duration = {}) const;
+        std::string render(const Metrics::SeriesKey &key, size_t value, Clock::duration duration = {}) const
+        {
+            std::string out;
+            render(out, key, value, duration);
+            return out;
+        }
+
+        static void appendDuration(std::string &out, Clock::duration d); /// "1д 2ч 3м 4с 5мс"
+
+    private:
+        enum class Kind : uint8_t { Literal, Metric, Value, Duration, Tags, Tag };
+        struct Token {
+            Kind kind;
+            uint32_t offset = 0; /// Literal: отрезок text_, Tag: номер ключа в keys_
+            uint32_t size   = 0;
+        };
+        struct TagKey {
+            uint32_t offset, size;     /// Ключ в text_: отрезок, а не string_view, шаблон можно перемещать
+            mutable uint32_t hint = 0; /// Позиция тега у последней серии
+        };
+
+        const Metrics::TagView *find(const TagKey &tag, const Metrics::SeriesKey &key) const;
+
+        std::string text_;
+        std::vector<Token> tokens_;
+        std::vector<TagKey> keys_;
+        size_t literal_size_ = 0; /// Для reserve
+        bool duration_       = false;
+    };
+
+} // namespace NotifierSystem
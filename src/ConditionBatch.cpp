@@ -0,0 +1,141 @@
+#include "ConditionBatch.hpp"
+#include <algorithm>
+#include <tuple>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace NotifierSystem
+{
+
+    namespace
+    {
+        constexpr ConditionBatch::Interval empty = {1, 0};
+
+        void evaluateScalar(const size_t *values, const size_t *lo0, const size_t *hi0, const size_t *lo1,
+                            const size_t *hi1, size_t count, uint64_t *mask)
+        {
+            for (size_t i = 0; i < count; i++) {
+                auto v   = values[i];
+                bool hit = (v >= lo0[i] && v <= hi0[i]) | (v >= lo1[i] && v <= hi1[i]);
+                mask[i / 64] |= uint64_t(hit) << (i % 64);
+            }
+        }
+
+#if defined(__x86_64__)
+        // Беззнаковое сравнение 64-битных чисел — знаковое после инверсии старшего бита.
+        // v вне [lo, hi] <=> lo > v || v > hi, условие ложно, если значение вне обоих отрезков.
+        __attribute__((target("avx2"))) inline __m256i loadAvx2(const size_t *p)
+        {
+            return _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)),
+                                    _mm256_set1_epi64x(INT64_MIN));
+        }
+
+        __attribute__((target("sse4.2"))) inline __m128i loadSse42(const size_t *p)
+        {
+            return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), _mm_set1_epi64x(INT64_MIN));
+        }
+
+        __attribute__((target("avx2"))) void evaluateAvx2(const size_t *values, const size_t *lo0, const size_t *hi0,
+                                                           const size_t *lo1, const size_t *hi1, size_t count,
+                                                           uint64_t *mask)
+        {
+            for (size_t i = 0; i < count; i += 4) {
+                auto v    = loadAvx2(values + i);
+                auto out0 = _mm256_or_si256(_mm256_cmpgt_epi64(loadAvx2(lo0 + i), v),
+                                            _mm256_cmpgt_epi64(v, loadAvx2(hi0 + i)));
+                auto out1 = _mm256_or_si256(_mm256_cmpgt_epi64(loadAvx2(lo1 + i), v),
+                                            _mm256_cmpgt_epi64(v, loadAvx2(hi1 + i)));
+                auto miss = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_and_si256(out0, out1)));
+                mask[i / 64] |= uint64_t(~miss & 0xF) << (i % 64);
+            }
+        }
+
+        __attribute__((target("sse4.2"))) void evaluateSse42(const size_t *values, const size_t *lo0, const size_t *hi0,
+                                                              const size_t *lo1, const size_t *hi1, size_t count,
+                                                              uint64_t *mask)
+        {
+            for (size_t i = 0; i < count; i += 2) {
+                auto v    = loadSse42(values + i);
+                auto out0 = _mm_or_si128(_mm_cmpgt_epi64(loadSse42(lo0 + i), v), _mm_cmpgt_epi64(v, loadSse42(hi0 + i)));
+                auto out1 = _mm_or_si128(_mm_cmpgt_epi64(loadSse42(lo1 + i), v), _mm_cmpgt_epi64(v, loadSse42(hi1 + i)));
+                auto miss = _mm_movemask_pd(_mm_castsi128_pd(_mm_and_si128(out0, out1)));
+                mask[i / 64] |= uint64_t(~miss & 0x3) << (i % 64);
+            }
+        }
+#endif
+    }
+
+    void ConditionBatch::clear()
+    {
+        values_.clear();
+        lo0_.clear();
+        hi0_.clear();
+        lo1_.clear();
+        hi1_.clear();
+        scalar_.clear();
+        size_ = 0;
+    }
+
+    size_t ConditionBatch::add(std::span<const Interval> intervals)
+    {
+        auto lane = size_++;
+        if (lane % lanes == 0) {
+            values_.resize(lane + lanes, 0);
+            lo0_.resize(lane + lanes, empty.first);
+            hi0_.resize(lane + lanes, empty.second);
+            lo1_.resize(lane + lanes, empty.first);
+            hi1_.resize(lane + lanes, empty.second);
+        }
+        if (intervals.size() > 2) {
+            scalar_.emplace_back(lane, std::vector<Interval>(intervals.begin(), intervals.end()));
+            return lane;
+        }
+        if (intervals.size() > 0) std::tie(lo0_[lane], hi0_[lane]) = intervals[0];
+        if (intervals.size() > 1) std::tie(lo1_[lane], hi1_[lane]) = intervals[1];
+        return lane;
+    }
+
+    void ConditionBatch::evaluate(std::span<uint64_t> mask, Isa isa) const
+    {
+        std::fill_n(mask.begin(), words(), 0);
+        auto run = [&](auto kernel) {
+            kernel(values_.data(), lo0_.data(), hi0_.data(), lo1_.data(), hi1_.data(), values_.size(), mask.data());
+        };
+        switch (isa) {
+#if defined(__x86_64__)
+            case Isa::AVX2: run(evaluateAvx2); break;
+            case Isa::SSE42: run(evaluateSse42); break;
+#endif
+            default: run(evaluateScalar);
+        }
+        for (auto &[lane, intervals] : scalar_) {
+            auto v   = values_[lane];
+            bool hit = std::any_of(intervals.begin(), intervals.end(),
+                                   [v](const Interval &i) { return v >= i.first && v <= i.second; });
+            mask[lane / 64] |= uint64_t(hit) << (lane % 64);
+        }
+    }
+
+    ConditionBatch::Isa ConditionBatch::best()
+    {
+#if defined(__x86_64__)
+        static const Isa isa = __builtin_cpu_supports("avx2")     ? Isa::AVX2
+                               : __builtin_cpu_supports("sse4.2") ? Isa::SSE42
+                                                                  : Isa::Scalar;
+        return isa;
+#else
+        return Isa::Scalar;
+#endif
+    }
+
+    const char *ConditionBatch::name(Isa isa)
+    {
+        switch (isa) {
+            case Isa::AVX2: return "avx2";
+            case Isa::SSE42: return "sse4.2";
+            default: return "scalar";
+        }
+    }
+
+} // namespace NotifierSystem
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace NotifierSystem
+{
+
+    /// Условия всех привязанных правил в виде структуры массивов: значения и границы отрезков лежат подряд
+    /// и за такт проверяются одним проходом AVX2 или SSE4.2, результат — битовая маска по полосам.
+    /// Условие из одного или двух отрезков (любое сравнение, включая !=) проверяется векторно,
+    /// условие с большим числом отрезков — скалярно, так же как Condition::check.
+    class ConditionBatch
+    {
+    public:
+        using Interval = std::pair<size_t, size_t>;
+        enum class Isa { Scalar, SSE42, AVX2 };
+
+        void clear();
+        /// Новая полоса с условием "значение попадает в один из intervals", возвращает ее номер
+        size_t add(std::span<const Interval> intervals);
+        size_t size() const { return size_; }
+        size_t words() const { return (size_ + 63) / 64; } /// Слов в маске результата
+
+        /// Значения полос, заполняются перед evaluate
+        size_t *values() { return values_.data(); }
+
+        /// Бит i % 64 слова i / 64 — истинно ли условие полосы i, mask.size() >= words()
+        void evaluate(std::span<uint64_t> mask) const { evaluate(mask, best()); }
+        void evaluate(std::span<uint64_t> mask, Isa isa) const;
+
+        static Isa best(); /// Лучший набор инструкций, доступный на этом процессоре
+        static const char *name(Isa isa);
+
+    private:
+        static constexpr size_t lanes = 4; /// Массивы дополнены до ширины AVX2 отрезками, в которые ничего не попадает
+        std::vector<size_t> values_, lo0_, hi0_, lo1_, hi1_;
+        std::vector<std::pair<size_t, std::vector<Interval>>> scalar_; /// Полоса -> отрезки, если их больше двух
+        size_t size_ = 0;
+    };
+
+} // namespace NotifierSystem
@@ -0,0 +1,158 @@
+#pragma once
+#include "Metrics.hpp"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace Metrics
+{
+
+    /// Семейство метрик с одинаковым именем и разными значениями меток:
+    ///     Metrics::MetricFamily<Metrics::Counter> requests("requests", {"peer"});
+    ///     requests.withLabels(peer)++;
+    /// Дочерние метрики создаются при первом обращении и хранятся в хэш-таблице с открытой адресацией
+    /// фиксированного размера. Поиск существующей метрики не выделяет память и не берет блокировок,
+    /// под мьютексом только создание новой. Сверх max_children все новые значения меток попадают
+    /// в одну метрику со значениями "__overflow__".
+    template <class T> class MetricFamily
+    {
+    public:
+        using Factory = std::function<std::unique_ptr<T>(const std::string &name, const std::vector<Tag> &tags)>;
+
+        static constexpr std::string_view overflow_value = "__overflow__";
+
+        MetricFamily(const std::string &name, std::vector<std::string> label_names, size_t max_children = 1024,
+                     std::vector<Tag> const_tags = {}, Mode mode = Mode::Plain)
+            requires std::is_constructible_v<T, std::string, std::vector<Tag>, Mode>
+            : MetricFamily(name, std::move(label_names), max_children, std::move(const_tags),
+                           [mode](const std::string &name, const std::vector<Tag> &tags) {
+                               return std::make_unique<T>(name, tags, mode);
+                           })
+        {
+        }
+
+        /// Для метрик с другим конструктором, например Histogram
+        MetricFamily(const std::string &name, std::vector<std::string> label_names, size_t max_children,
+                     std::vector<Tag> const_tags, Factory factory)
+            : name_(name), labels_(std::move(label_names)), const_tags_(std::move(const_tags)),
+              factory_(std::move(factory)), max_children_(std::max<size_t>(max_children, 1)),
+              capacity_(std::bit_ceil(max_children_ * 2)), table_(std::make_unique<std::atomic<Child *>[]>(capacity_)),
+              cardinality_(std::make_unique<Gauge>("MetricFamily_cardinality", std::vector<Tag>{{"family", name}},
+                                                   Mode::Sharded)),
+              overflowed_(std::make_unique<Counter>("MetricFamily_overflow", std::vector<Tag>{{"family", name}},
+                                                    Mode::Sharded))
+        {
+        }
+
+        ~MetricFamily() { *cardinality_ = 0; }
+
+        MetricFamily(const MetricFamily &)            = delete;
+        MetricFamily &operator=(const MetricFamily &) = delete;
+
+        /// Значения меток в порядке label_names, приводимые к std::string_view
+        template <class... Values> T &withLabels(const Values &...values)
+        {
+            std::array<std::string_view, sizeof...(Values)> views = {std::string_view(values)...};
+            if (views.size() != labels_.size())
+                throw std::invalid_argument("MetricFamily " + name_ + ": labels count mismatch");
+            auto hash = hashLabels(views);
+            for (size_t i = hash & (capacity_ - 1);; i = (i + 1) & (capacity_ - 1)) {
+                auto child = table_[i].load(std::memory_order_acquire);
+                if (!child) break;
+                if (child->hash == hash && child->equals(views)) return *child->metric;
+            }
+            if (auto overflow = overflow_.load(std::memory_order_acquire)) {
+                (*overflowed_)++;
+                return *overflow->metric;
+            }
+            return insert(views, hash);
+        }
+
+        size_t cardinality() const { return size_.load(std::memory_order_relaxed); }
+
+    private:
+        struct Child {
+            uint64_t hash;
+            std::vector<std::string> values;
+            std::unique_ptr<T> metric;
+
+            bool equals(std::span<const std::string_view> views) const
+            {
+                for (size_t i = 0; i < views.size(); i++)
+                    if (values[i] != views[i]) return false;
+                return true;
+            }
+        };
+
+        static uint64_t hashLabels(std::span<const std::string_view> values)
+        {
+            uint64_t hash = hashBytes({});
+            for (auto value : values) hash = hashBytes(std::string_view("\0", 1), hashBytes(value, hash));
+            return hash;
+        }
+
+        T &insert(std::span<const std::string_view> views, uint64_t hash)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t i = hash & (capacity_ - 1);
+            for (;; i = (i + 1) & (capacity_ - 1)) {
+                auto child = table_[i].load(std::memory_order_relaxed);
+                if (!child) break;
+                if (child->hash == hash && child->equals(views)) return *child->metric;
+            }
+            if (size_ >= max_children_) {
+                (*overflowed_)++;
+                if (!overflow_child_) {
+                    overflow_child_ = create(std::vector<std::string_view>(views.size(), overflow_value), 0);
+                    overflow_.store(overflow_child_.get(), std::memory_order_release);
+                }
+                return *overflow_child_->metric;
+            }
+            auto &child = children_.emplace_back(create({views.begin(), views.end()}, hash));
+            table_[i].store(child.get(), std::memory_order_release);
+            size_.fetch_add(1, std::memory_order_relaxed);
+            *cardinality_ = size_.load(std::memory_order_relaxed);
+            return *child->metric;
+        }
+
+        std::unique_ptr<Child> create(std::vector<std::string_view> views, uint64_t hash)
+        {
+            auto child  = std::make_unique<Child>();
+            child->hash = hash;
+            auto tags   = const_tags_;
+            for (size_t i = 0; i < views.size(); i++) {
+                child->values.emplace_back(views[i]);
+                tags.emplace_back(labels_[i], views[i]);
+            }
+            child->metric = factory_(name_, tags);
+            return child;
+        }
+
+        std::string name_;
+        std::vector<std::string> labels_;
+        std::vector<Tag> const_tags_;
+        Factory factory_;
+        size_t max_children_;
+        size_t capacity_; /// Степень двойки, не меньше 2 * max_children, поэтому таблица никогда не растет
+        std::unique_ptr<std::atomic<Child *>[]> table_;
+        std::atomic<size_t> size_ = 0;
+
+        std::mutex mutex_; /// Только для создания дочерних метрик
+        std::deque<std::unique_ptr<Child>> children_;
+        std::unique_ptr<Child> overflow_child_;
+        std::atomic<Child *> overflow_ = nullptr; /// Появляется после заполнения таблицы, дальше поиск без мьютекса
+
+        std::unique_ptr<Gauge> cardinality_;  /// MetricFamily_cardinality_gauge{family=name}
+        std::unique_ptr<Counter> overflowed_; /// Обращения со значениями меток сверх max_children
+    };
+
+} // namespace Metrics
@@ -1,7 +1,10 @@
 #pragma once
 #include "Metrics.hpp"
+#include "MetricsSnapshot.hpp"
 #include <boost/asio/io_context.hpp>
+#include <memory>
 #include <set>
+#include <vector>
 
 namespace Metrics
 {
@@ -10,7 +13,56 @@ namespace Metrics
     {
     public:
         boost::asio::io_context *io;
+        /// false — upload() с копиями метрик из снимка такта, реестр при этом не обходится,
+        /// true  — uploadSnapshot() с копией значений после завершения обхода
+        bool use_snapshot = false;
+        /// Только с use_snapshot: uploadSnapshot() получает лишь серии, изменившиеся после прошлой успешной
+        /// выгрузки (завершившейся без исключения), и полный снимок первым и раз в resync_every тактов.
+        /// Удаленные серии в частичных снимках не видны, только по их отсутствию в полном.
+        bool changes_only   = false;
+        size_t resync_every = 60;
+        /// Если не 0: выгрузка по своему расписанию раз в interval_ms миллисекунд, а не на такте модели.
+        /// Задается до registerUploader
+        size_t interval_ms = 0;
         virtual void upload(std::set<Metrics::Metric *> &statistics) = 0;
+        /// По умолчанию — upload() с копиями метрик снимка, не зарегистрированными в реестре.
+        /// Загрузчик с use_snapshot переопределяет его, а upload() оставляет пустым
+        virtual void uploadSnapshot(const Snapshot &snapshot);
+        virtual ~Uploader() = default;
+
+    private:
+        /// Копии по series_id, только из strand загрузчика: указатель на серию не меняется от такта к такту
+        std::vector<std::unique_ptr<Metric>> copies_;
     };
 
+    inline void Uploader::uploadSnapshot(const Snapshot &snapshot)
+    {
+        std::set<Metric *> metrics;
+        std::vector<bool> seen(copies_.size());
+        for (auto &sample : snapshot.samples) {
+            if (sample.id >= copies_.size()) {
+                copies_.resize(sample.id + 1);
+                seen.resize(sample.id + 1);
+            }
+            auto &copy = copies_[sample.id];
+            if (!copy) {
+                auto &key = snapshot.key(sample);
+                std::vector<Tag> tags;
+                for (auto &[name, value] : key.tags) tags.emplace_back(name, value);
+                copy              = std::unique_ptr<Metric>(new Metric(std::string(key.name), tags, Metric::Deferred{}));
+                copy->series_id   = sample.id;
+                copy->series_hash = key.hash;
+            }
+            copy->imported = sample.imported;
+            copy->storeValue(sample.value);
+            seen[sample.id] = true;
+            metrics.insert(copy.get());
+        }
+        // Серии, пропавшие из полного снимка, удалены владельцами
+        if (snapshot.full)
+            for (size_t id = 0; id < copies_.size(); id++)
+                if (!seen[id]) copies_[id].reset();
+        upload(metrics);
+    }
+
 } // namespace Metrics
\ No newline at end of file
@@ -2,50 +2,244 @@
 #include "MetricsModel.hpp"
 #include "iostream"
 #include <PluginCore/Logger/Log>
+#include <algorithm>
+#include <cmath>
 namespace Metrics
 {
 
-    Metric::Metric(const std::string &name_, const std::vector<Tag> &tags_) : tags(tags_), name(name_)
+    size_t ShardedValue::load() const noexcept
+    {
+        size_t sum = 0;
+        for (auto &slot : slots_) sum += slot.value.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    void ShardedValue::sub(size_t val) noexcept
+    {
+        // Слот не уходит ниже нуля, поэтому и сумма не уходит: сначала свой слот, затем остальные по кругу
+        size_t first = threadIndex() % shards;
+        for (size_t i = 0; i < shards && val; i++) {
+            auto &slot = slots_[(first + i) % shards].value;
+            size_t cur = slot.load(std::memory_order_relaxed);
+            while (cur && !slot.compare_exchange_weak(cur, cur - std::min(cur, val), std::memory_order_relaxed)) {}
+            val -= std::min(cur, val);
+        }
+    }
+
+    size_t ShardedValue::exchange(size_t val) noexcept
+    {
+        size_t sum = 0;
+        for (auto &slot : slots_) sum += slot.value.exchange(0, std::memory_order_relaxed);
+        slots_[threadIndex() % shards].value.fetch_add(val, std::memory_order_relaxed);
+        return sum;
+    }
+
+    void ShardedValue::store(size_t val) noexcept { exchange(val); }
+
+    Metric::Metric(const std::string &name_, const std::vector<Tag> &tags_, Mode mode) : Metric(name_, tags_, mode, false)
+    {
+        attach();
+    }
+
+    Metric::Metric(const std::string &name_, const std::vector<Tag> &tags_, Mode mode, bool direct)
+        : tags(tags_), name(name_), direct_(direct)
+    {
+        if (mode == Mode::Sharded) shards_ = std::make_shared<ShardedValue>();
+    }
+
+    Metric::Metric(const std::string &name_, const std::vector<Tag> &tags_, Deferred) : tags(tags_), name(name_) {}
+
+    void Metric::attach(std::span<const TagView> sorted_tags, uint64_t precomputed_hash)
     {
         if (MetricsModel::instance()) {
-            parent = MetricsModel::instance();
-            std::lock_guard<std::mutex> lock(parent->statistics_mutex_);
-            parent->metrics_.insert(this);
-            metrics_key = name;
-            if (tags.size()) metrics_key += " tags=";
-            for (int i = 0; i < tags.size(); i++) {
-                metrics_key += tags[i].first + "=" + tags[i].second;
-                if (i != tags.size() - 1) metrics_key += ", ";
+            parent          = MetricsModel::instance();
+            bool limited    = !(tags.size() == 1 && tags.front() == overflow_tag);
+            auto [id, hash] = precomputed_hash ? parent->keys_.intern(name, sorted_tags, precomputed_hash, limited)
+                                               : parent->keys_.intern(name, tags, limited);
+            if (id == KeyTable::no_id) {
+                // Серия сверх maxSeries/maxSeriesPerName: метрика пишет в общие шарды серии __overflow__ своего имени
+                // и не регистрируется, выгружается только серия модели
+                auto overflow = parent->overflowSeries(name);
+                tags          = {overflow_tag};
+                shards_       = overflow->shards_;
+                series_id     = overflow->series_id;
+                series_hash   = overflow->series_hash;
+                if (auto &overflowed = parent->self_metrics_.series_overflow) (*overflowed)++;
+                parent = nullptr;
+                releaseKey();
+                return;
             }
-            G_LOG(1, "Created metric :" << metrics_key);
+            series_id       = id;
+            series_hash     = hash;
+            slot_           = parent->registry_.reserve();
+            // Ячейка выдается до публикации слота: обход не увидит метрику, пишущую мимо хранилища
+            if (direct_ && !shards_ && parent->values_.enabled()) cell_ = parent->values_.bind(slot_);
+            if (direct_) parent->restore(*this);
+            parent->registry_.publish(slot_, this);
+            G_LOG(1, "Created metric :" << key()->key);
+            releaseKey();
         } else {
-            R_LOG(1, "MetricsModel::instance() is null! Can't register metrics " << name_);
+            R_LOG(1, "MetricsModel::instance() is null! Can't register metrics " << name);
             R_LOG(1, "All plugins, used MetricsModel must load it in register model and initialisate "
                      "MetricsModel::instance()!!!");
         }
     }
 
-    Metric::~Metric()
+    void Metric::releaseKey()
+    {
+        std::string().swap(name);
+        std::vector<Tag>().swap(tags);
+    }
+
+    void Metric::detach()
     {
         if (parent) {
-            std::lock_guard<std::mutex> lock(parent->statistics_mutex_);
-            parent->metrics_.erase(this);
+            // Ячейка снимается, пока слот еще наш: после remove его может занять новая метрика
+            parent->values_.unbind(slot_);
+            parent->registry_.remove(slot_);
+            parent->keys_.release(series_id);
         }
+        parent = nullptr;
+    }
+
+    Metric::~Metric() { detach(); }
+
+    void Metric::collect()
+    {
+        if (shards_) storeValue(shards_->load());
     }
 
     std::string Metric::toString(bool with_value) const
     {
-        return with_value ? metrics_key + ": " + std::to_string(value_) : metrics_key;
+        std::string text(key() ? key()->key : name);
+        return with_value ? text + ": " + std::to_string(value()) : text;
     }
 
-    Bool::Bool(const std::string &name, const std::vector<Tag> &tags) : Metric(name, tags) {}
+    const SeriesKey *Metric::key() const
+    {
+        // Копии для Uploader::upload и метрики серии __overflow__ не привязаны к модели, но их серии интернированы в ней
+        auto model = parent ? parent : MetricsModel::instance();
+        return model && series_id != KeyTable::no_id ? &model->keys_[series_id] : nullptr;
+    }
 
-    Counter::Counter(const std::string &name, const std::vector<Tag> &tags) : Metric(name + "_counter", tags) {}
+    Bool::Bool(const std::string &name, const std::vector<Tag> &tags) : Metric(name, tags, Mode::Plain, true)
+    {
+        attach();
+    }
+
+    Bool::~Bool() { detach(); }
+
+    Counter::Counter(const std::string &name, const std::vector<Tag> &tags, Mode mode)
+        : Metric(name + "_counter", tags, mode, true)
+    {
+        attach();
+    }
 
-    Gauge::Gauge(const std::string &name, const std::vector<Tag> &tags) : Metric(name + "_gauge", tags) {}
+    Counter::~Counter() { detach(); }
 
-    CounterGauge::CounterGauge(const std::string &name, const std::vector<Tag> &tags)
-        : counter_(name, tags), gauge_(name, tags)
+    Gauge::Gauge(const std::string &name, const std::vector<Tag> &tags, Mode mode)
+        : Metric(name + "_gauge", tags, mode, true)
+    {
+        attach();
+    }
+
+    Histogram::Buckets Histogram::Buckets::linear(size_t start, size_t width, size_t count)
+    {
+        Buckets buckets;
+        buckets.layout = Layout::Linear;
+        buckets.start  = start;
+        buckets.width  = std::max<size_t>(width, 1);
+        for (size_t i = 0; i < count; i++) buckets.bounds.push_back(start + i * buckets.width);
+        return buckets;
+    }
+
+    Histogram::Buckets Histogram::Buckets::logLinear(size_t max, unsigned sub_bits)
+    {
+        Buckets buckets;
+        buckets.layout   = Layout::LogLinear;
+        buckets.sub_bits = std::min(sub_bits, 8u);
+        size_t sub       = size_t(1) << buckets.sub_bits;
+        // До 2^sub_bits корзины по одному значению, дальше 2^sub_bits корзин на каждую степень двойки
+        for (size_t v = 0; v < sub && v <= max; v++) buckets.bounds.push_back(v);
+        for (unsigned e = buckets.sub_bits; e < 64 && buckets.bounds.back() < max; e++)
+            for (size_t m = 0; m < sub && buckets.bounds.back() < max; m++)
+                buckets.bounds.push_back(((sub + m + 1) << (e - buckets.sub_bits)) - 1);
+        return buckets;
+    }
+
+    Histogram::Histogram(const std::string &name, Buckets buckets, const std::vector<Tag> &tags)
+        : Metric(name + "_histogram", tags, Deferred{}), buckets_(std::move(buckets))
+    {
+        if (buckets_.layout == Buckets::Layout::Bounds) {
+            std::sort(buckets_.bounds.begin(), buckets_.bounds.end());
+            buckets_.bounds.erase(std::unique(buckets_.bounds.begin(), buckets_.bounds.end()), buckets_.bounds.end());
+        }
+        bucket_count_ = buckets_.bounds.size() + 1;
+        stride_       = (bucket_count_ + 1 + 7) / 8 * 8;
+        storage_      = std::make_unique<std::atomic<size_t>[]>(shards * stride_ + 8);
+        auto address  = reinterpret_cast<uintptr_t>(storage_.get());
+        cells_        = storage_.get() + (64 - address % 64) % 64 / sizeof(std::atomic<size_t>);
+        merged_       = std::make_unique<std::atomic<size_t>[]>(bucket_count_ + 1);
+
+        for (auto bound : buckets_.bounds) {
+            auto bucket_tags = tags;
+            bucket_tags.push_back({"le", std::to_string(bound)});
+            series_.push_back(std::make_unique<Series>(*this, name + "_histogram_bucket", bucket_tags));
+        }
+        auto inf_tags = tags;
+        inf_tags.push_back({"le", "+Inf"});
+        series_.push_back(std::make_unique<Series>(*this, name + "_histogram_bucket", inf_tags));
+        series_.push_back(std::make_unique<Series>(*this, name + "_histogram_sum", tags));
+        attach();
+    }
+
+    Histogram::~Histogram() { detach(); }
+
+    Histogram::Series::Series(Histogram &owner, const std::string &name, const std::vector<Tag> &tags)
+        : Metric(name, tags, Deferred{}), owner_(owner)
+    {
+        attach();
+    }
+
+    Histogram::Series::~Series() { detach(); }
+
+    void Histogram::collect()
+    {
+        size_t cumulative = 0;
+        for (size_t i = 0; i <= bucket_count_; i++) {
+            size_t total = 0;
+            for (size_t shard = 0; shard < shards; shard++)
+                total += cells_[shard * stride_ + i].load(std::memory_order_relaxed);
+            merged_[i].store(total, std::memory_order_relaxed);
+            if (i < bucket_count_) cumulative += total;
+            series_[i]->storeValue(i < bucket_count_ ? cumulative : total);
+        }
+        storeValue(cumulative);
+    }
+
+    size_t Histogram::quantile(double q) const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < bucket_count_; i++) total += merged_[i].load(std::memory_order_relaxed);
+        if (!total) return 0;
+        auto rank         = std::max<size_t>(1, std::ceil(std::clamp(q, 0.0, 1.0) * total));
+        size_t cumulative = 0;
+        for (size_t i = 0; i + 1 < bucket_count_; i++)
+            if ((cumulative += merged_[i].load(std::memory_order_relaxed)) >= rank) return buckets_.bounds[i];
+        return SIZE_MAX; // Значение в корзине +Inf
+    }
+
+    size_t Histogram::count() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < bucket_count_; i++) total += merged_[i].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    size_t Histogram::sum() const { return merged_[bucket_count_].load(std::memory_order_relaxed); }
+
+    CounterGauge::CounterGauge(const std::string &name, const std::vector<Tag> &tags, Mode mode)
+        : counter_(name, tags, mode), gauge_(name, tags, mode)
     {
     }
 
@@ -69,51 +263,71 @@ namespace Metrics
 
     Gauge &Gauge::operator=(size_t val)
     {
-        value_ = val;
+        if (shards_)
+            shards_->store(val);
+        else
+            store(val);
         return *this;
     }
 
     Gauge &Gauge::operator--(int)
     {
-        if (value_) value_--;
+        if (shards_)
+            shards_->sub(1);
+        else if (auto current = value())
+            store(current - 1);
         return *this;
     }
 
     Gauge &Gauge::operator-=(size_t val)
     {
-        if (value_ > val)
-            value_ -= val;
+        if (shards_)
+            shards_->sub(val);
         else
-            value_ = 0;
+            store(value() > val ? value() - val : 0);
         return *this;
     }
 
     Gauge &Gauge::operator++(int)
     {
-        value_++;
+        if (shards_)
+            shards_->add(1);
+        else
+            store(value() + 1);
         return *this;
     }
 
     Gauge &Gauge::operator+=(size_t val)
     {
-        value_ += val;
+        if (shards_)
+            shards_->add(val);
+        else
+            store(value() + val);
         return *this;
     }
 
     Gauge::~Gauge()
     {
-        if (value_) R_LOG(1, "[Metrics::Gauge]" << name << " in destructor value was't zero. Metric = " << value_);
+        if (size_t value = *this)
+            R_LOG(1, "[Metrics::Gauge]" << toString(false) << " in destructor value was't zero. Metric = " << value);
+        detach();
     }
 
     Counter &Counter::operator++(int)
     {
-        value_++;
+        if (shards_)
+            shards_->add(1);
+        else
+            store(value() + 1);
         return *this;
     }
 
     Counter &Counter::operator+=(size_t val)
     {
-        value_ += val;
+        if (shards_)
+            shards_->add(val);
+        else
+            store(value() + val);
         return *this;
     }
 
@@ -145,15 +359,15 @@ namespace Metrics
 
     Bool &Bool::operator=(bool val)
     {
-        value_ = val ? 1 : 0;
+        store(val ? 1 : 0);
         return *this;
     }
 
-    Bool::operator bool() const { return value_; }
+    Bool::operator bool() const { return value(); }
 
-    Gauge::operator size_t() const { return value_; }
+    Gauge::operator size_t() const { return shards_ ? shards_->load() : value(); }
 
-    Counter::operator size_t() const { return value_; }
+    Counter::operator size_t() const { return shards_ ? shards_->load() : value(); }
 
     Counter &CounterGauge::getCounter() { return counter_; }
 
@@ -161,8 +375,9 @@ namespace Metrics
 
     size_t Counter::exchange(size_t val)
     {
-        auto tmp = value_;
-        value_   = val;
+        if (shards_) return shards_->exchange(val);
+        auto tmp = value();
+        store(val);
         return tmp;
     }
 } // namespace Metrics
\ No newline at end of file
@@ -1,6 +1,11 @@
 #pragma once
+#include "SeriesKeys.hpp"
+#include <algorithm>
 #include <atomic>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <termios.h>
 #include <vector>
@@ -8,29 +13,114 @@
 class MetricsModel;
 namespace Metrics
 {
+    class ValueStore;
 
-    using Tag = std::pair<std::string, std::string>;
+    /// Режим хранения значения метрики
+    enum class Mode {
+        Plain,  /// Обычное поле value_, для метрик, изменяемых из одного потока
+        Sharded /// Слоты на поток, без конкуренции за кэш-линию, сливаются в value_ при сборе
+    };
+
+    /// Номер потока для выбора шарда, назначается по кругу при первом обращении
+    inline size_t threadIndex() noexcept
+    {
+        static std::atomic<size_t> next = 0;
+        static thread_local size_t idx  = next.fetch_add(1, std::memory_order_relaxed);
+        return idx;
+    }
+
+    /// Значение, разнесенное по выровненным на кэш-линию слотам. Каждый поток пишет в свой слот,
+    /// сумма считается только при чтении.
+    class ShardedValue
+    {
+    public:
+        static constexpr size_t shards = 64;
+
+        void add(size_t val) noexcept { slots_[threadIndex() % shards].value.fetch_add(val, std::memory_order_relaxed); }
+        /// Насыщается в 0, как Gauge без шардов: недостающее списывается из слотов других потоков
+        void sub(size_t val) noexcept;
+        size_t load() const noexcept;
+        size_t exchange(size_t val) noexcept;
+        void store(size_t val) noexcept;
+
+    private:
+        struct alignas(64) Slot {
+            std::atomic<size_t> value = 0;
+        };
+        Slot slots_[shards];
+    };
+
+    /// Тег серии, в которую сводятся метрики сверх бюджета серий MetricsModel
+    inline const Tag overflow_tag = {"__overflow__", "true"};
 
     class Metric
     {
         friend class ::MetricsModel;
+        friend class ValueStore;
+        friend class Uploader;
         MetricsModel *parent = nullptr;
-        std::string metrics_key;
+        uint32_t slot_       = 0; /// Слот в Metrics::Registry
 
     public:
-        Metric(const std::string &name, const std::vector<Tag> &tags = {});
+        Metric(const std::string &name, const std::vector<Tag> &tags = {}, Mode mode = Mode::Plain);
         std::string toString(bool with_value = true) const;
+        const SeriesKey *key() const; /// Интернированный ключ, nullptr если MetricsModel не был доступен
+        virtual void collect(); /// Сливает шарды в value_, вызывается потоком MetricsModel перед выгрузкой
+        /// Метрика, чей collect() выставляет значение этой: у серий корзин и суммы Histogram — сама гистограмма
+        virtual Metric *collector() { return this; }
+        /// Текущее значение без шардов: ячейка ValueStore, если метрика пишет в нее, иначе value_
+        size_t value() const { return cell_ ? cell_->load(std::memory_order_relaxed) : loadValue(); }
+        virtual size_t quantile(double q) const { return loadValue(); } /// q от 0 до 1, у Histogram — по корзинам
         virtual ~Metric();
-        size_t value_ = 0;
+        /// value_ пишут владелец и сбор, а читают такты, загрузчики и правила из других потоков: доступ только
+        /// через relaxed atomic_ref, на x86 это те же обычные mov
+        size_t loadValue() const noexcept
+        {
+            return std::atomic_ref<size_t>(const_cast<size_t &>(value_)).load(std::memory_order_relaxed);
+        }
+        void storeValue(size_t val) noexcept { std::atomic_ref<size_t>(value_).store(val, std::memory_order_relaxed); }
+        alignas(std::atomic_ref<size_t>::required_alignment) size_t value_ = 0;
+        /// Только у метрик без модели и у копий для Uploader::upload: зарегистрированная метрика отдает
+        /// имя и теги после attach(), они есть в key()
         std::vector<Tag> tags;
         std::string name;
         bool imported = false; // Для метрик, импортированных из другого хранилища метрик
+        uint32_t series_id   = KeyTable::no_id; /// Один и тот же для всех метрик с одинаковыми именем и тегами
+        uint64_t series_hash = 0;               /// Хэш имени и отсортированных тегов
+
+    protected:
+        struct Deferred {
+        };
+        /// Наследники регистрируются сами через attach() в конце своего конструктора и снимаются через detach()
+        /// в начале деструктора. Конструкторы и деструкторы классов иерархии перезаписывают vptr, поэтому поток
+        /// модели, вызывающий виртуальные collect()/quantile(), должен видеть объект только целиком построенным.
+        Metric(const std::string &name, const std::vector<Tag> &tags, Deferred);
+        /// direct: значение можно держать в ячейке ValueStore (Counter, Gauge, Bool), если хранилище включено.
+        /// Как и Deferred, не регистрирует метрику
+        Metric(const std::string &name, const std::vector<Tag> &tags, Mode mode, bool direct);
+        /// sorted_tags и hash — ключ, уже посчитанный при компиляции (StaticCounter), иначе он считается по name и tags
+        void attach(std::span<const TagView> sorted_tags = {}, uint64_t hash = 0);
+        void detach();
+        void releaseKey(); /// Освобождает name и tags, когда ключ уже интернирован
+
+        void store(size_t val)
+        {
+            if (cell_)
+                cell_->store(val, std::memory_order_relaxed);
+            else
+                storeValue(val);
+        }
+
+        std::shared_ptr<ShardedValue> shards_; /// Общий у метрик, сведенных в серию __overflow__
+        std::atomic<size_t> *cell_ = nullptr;  /// Ячейка ValueStore, пишет только владелец метрики
+        bool direct_               = false;
     };
 
     class Bool : protected Metric
     {
     public:
         Bool(const std::string &name, const std::vector<Tag> &tags = {});
+        ~Bool();
 
         Bool &operator=(bool val);
         operator bool() const;
@@ -39,7 +129,8 @@ namespace Metrics
     class Counter : protected Metric
     {
     public:
-        Counter(const std::string &name, const std::vector<Tag> &tags = {});
+        Counter(const std::string &name, const std::vector<Tag> &tags = {}, Mode mode = Mode::Plain);
+        ~Counter();
 
         Counter &operator++(int);
         Counter &operator+=(size_t val);
@@ -50,7 +141,7 @@ namespace Metrics
     class Gauge : protected Metric
     {
     public:
-        Gauge(const std::string &name, const std::vector<Tag> &tags = {});
+        Gauge(const std::string &name, const std::vector<Tag> &tags = {}, Mode mode = Mode::Plain);
         ~Gauge();
 
         Gauge &operator=(size_t val);
@@ -64,10 +155,96 @@ namespace Metrics
         friend class Guard;
     };
 
+    /// Гистограмма: запись — relaxed атомарное сложение в шард потока, корзины сливаются при сборе.
+    /// Регистрирует серии <name>_histogram (количество), <name>_histogram_sum и <name>_histogram_bucket{le=...}
+    /// с накопленными количествами, как в Prometheus.
+    class Histogram : protected Metric
+    {
+    public:
+        /// Включающие верхние границы корзин, последняя корзина +Inf добавляется сама
+        struct Buckets {
+            std::vector<size_t> bounds;
+            enum class Layout { Bounds, Linear, LogLinear } layout = Layout::Bounds;
+            size_t start     = 0; /// Linear
+            size_t width     = 1; /// Linear
+            unsigned sub_bits = 0; /// LogLinear: 2^sub_bits корзин на каждую степень двойки
+
+            static Buckets linear(size_t start, size_t width, size_t count);
+            static Buckets logLinear(size_t max, unsigned sub_bits = 2);
+        };
+
+        Histogram(const std::string &name, Buckets buckets, const std::vector<Tag> &tags = {});
+        ~Histogram();
+
+        /// Первые shards - 1 потоков процесса пишут каждый в свою строку без атомарного RMW,
+        /// остальные делят последнюю строку через fetch_add
+        void record(size_t value) noexcept
+        {
+            auto thread = threadIndex();
+            auto bucket = index(value);
+            if (thread < shards - 1) {
+                auto row = cells_ + thread * stride_;
+                row[bucket].store(row[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                row[bucket_count_].store(row[bucket_count_].load(std::memory_order_relaxed) + value,
+                                         std::memory_order_relaxed);
+            } else {
+                auto row = cells_ + (shards - 1) * stride_;
+                row[bucket].fetch_add(1, std::memory_order_relaxed);
+                row[bucket_count_].fetch_add(value, std::memory_order_relaxed);
+            }
+        }
+
+        void collect() override;
+        size_t quantile(double q) const override; /// По последнему слиянию, верхняя граница корзины
+        size_t count() const;
+        size_t sum() const;
+
+    private:
+        static constexpr size_t shards = 16;
+
+        size_t index(size_t value) const noexcept
+        {
+            auto count = bucket_count_ - 1;
+            switch (buckets_.layout) {
+                case Buckets::Layout::Linear:
+                    if (value <= buckets_.start) return 0;
+                    return std::min((value - buckets_.start + buckets_.width - 1) / buckets_.width, count);
+                case Buckets::Layout::LogLinear: {
+                    auto s = buckets_.sub_bits;
+                    if (value < (size_t(1) << s)) return std::min(value, count);
+                    unsigned e = std::bit_width(value) - 1;
+                    size_t m   = (value >> (e - s)) - (size_t(1) << s);
+                    return std::min((size_t(e - s + 1) << s) + m, count);
+                }
+                default:
+                    return std::lower_bound(buckets_.bounds.begin(), buckets_.bounds.end(), value) - buckets_.bounds.begin();
+            }
+        }
+
+        Buckets buckets_;
+        size_t bucket_count_; /// Вместе с +Inf
+        size_t stride_;       /// Ячеек на шард: корзины и сумма, кратно кэш-линии
+        std::unique_ptr<std::atomic<size_t>[]> storage_;
+        std::atomic<size_t> *cells_;
+        std::unique_ptr<std::atomic<size_t>[]> merged_; /// Корзины и сумма после последнего collect()
+        /// Серия корзины или суммы: значение выставляет collect() гистограммы
+        class Series : public Metric
+        {
+        public:
+            Series(Histogram &owner, const std::string &name, const std::vector<Tag> &tags);
+            ~Series();
+            Metric *collector() override { return &owner_; }
+
+        private:
+            Histogram &owner_;
+        };
+        std::vector<std::unique_ptr<Series>> series_; /// Корзины и сумма
+    };
+
     class CounterGauge
     {
     public:
-        CounterGauge(const std::string &name, const std::vector<Tag> &tags = {});
+        CounterGauge(const std::string &name, const std::vector<Tag> &tags = {}, Mode mode = Mode::Plain);
 
         CounterGauge &operator--(int);
         CounterGauge &operator-=(size_t val);
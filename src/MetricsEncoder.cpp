@@ -0,0 +1,166 @@
+#include "MetricsEncoder.hpp"
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+namespace Metrics
+{
+
+    namespace
+    {
+        /// [a-zA-Z_:][a-zA-Z0-9_:]* для имен, без ':' для меток; остальные символы заменяются на '_'
+        void appendName(std::string &out, std::string_view name, bool label)
+        {
+            if (name.empty() || (name.front() >= '0' && name.front() <= '9')) out += '_';
+            for (char c : name) {
+                bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' ||
+                             (c == ':' && !label);
+                out += valid ? c : '_';
+            }
+        }
+
+        void appendValue(std::string &out, std::string_view value)
+        {
+            for (char c : value) {
+                if (c == '\\') out += "\\\\";
+                else if (c == '"') out += "\\\"";
+                else if (c == '\n') out += "\\n";
+                else out += c;
+            }
+        }
+
+        bool strip(std::string &name, std::string_view suffix)
+        {
+            if (!name.ends_with(suffix)) return false;
+            name.resize(name.size() - suffix.size());
+            return true;
+        }
+    }
+
+    std::string_view TextEncoder::contentType(Format format)
+    {
+        return format == Format::OpenMetrics ? "application/openmetrics-text; version=1.0.0; charset=utf-8"
+                                             : "text/plain; version=0.0.4; charset=utf-8";
+    }
+
+    size_t TextEncoder::bytes() const
+    {
+        return prefixes_.capacity() + buffer_.capacity() + series_.capacity() * sizeof(Series) +
+               families_.capacity() * sizeof(Family) + order_.capacity() * sizeof(uint32_t) +
+               samples_.capacity() * sizeof(samples_[0]);
+    }
+
+    const TextEncoder::Series &TextEncoder::series(uint32_t id, const SeriesKey &key)
+    {
+        if (id >= series_.size()) series_.resize(id + 1);
+        auto &series = series_[id];
+        if (series.family != no_family) return series;
+
+        bool open = format_ == Format::OpenMetrics;
+        std::string name;
+        appendName(name, key.name, false);
+        std::string family    = name;
+        std::string_view kind = open ? "unknown" : "untyped";
+        if ((strip(family, "_bucket") || strip(family, "_sum")) && family.ends_with("_histogram"))
+            kind = "histogram";
+        else {
+            family = name;
+            if (name.ends_with("_histogram")) {
+                kind = "histogram";
+                name += "_count";
+            } else if (name.ends_with("_counter")) {
+                kind = "counter";
+                if (open) name += "_total";
+            } else if (name.ends_with("_gauge"))
+                kind = "gauge";
+        }
+
+        auto [it, inserted] = family_ids_.try_emplace(family, uint32_t(families_.size()));
+        if (inserted) {
+            auto header = "# TYPE " + family + " " + std::string(kind) + "\n";
+            families_.push_back({uint32_t(prefixes_.size()), uint32_t(header.size())});
+            prefixes_ += header;
+        }
+
+        series.offset = prefixes_.size();
+        prefixes_ += name;
+        if (!key.tags.empty()) {
+            prefixes_ += '{';
+            for (size_t i = 0; i < key.tags.size(); i++) {
+                if (i) prefixes_ += ',';
+                appendName(prefixes_, key.tags[i].first, true);
+                prefixes_ += "=\"";
+                appendValue(prefixes_, key.tags[i].second);
+                prefixes_ += '"';
+            }
+            prefixes_ += '}';
+        }
+        prefixes_ += ' ';
+        series.size   = prefixes_.size() - series.offset;
+        series.family = it->second;
+        return series;
+    }
+
+    std::string_view TextEncoder::encode(const Snapshot &snapshot)
+    {
+        samples_.clear();
+        for (auto &sample : snapshot.samples) {
+            series(sample.id, snapshot.key(sample));
+            samples_.emplace_back(sample.id, sample.value);
+        }
+        return render();
+    }
+
+    std::string_view TextEncoder::encode(const std::set<Metric *> &metrics)
+    {
+        samples_.clear();
+        for (auto metric : metrics)
+            if (auto key = metric->key()) {
+                series(metric->series_id, *key);
+                samples_.emplace_back(metric->series_id, metric->value());
+            }
+        return render();
+    }
+
+    std::string_view TextEncoder::render()
+    {
+        // Семейство должно идти одной группой: сортировка подсчетом по номеру семейства
+        for (auto &family : families_) family.start = 0;
+        size_t need = format_ == Format::OpenMetrics ? 6 : 0;
+        for (auto &[id, value] : samples_) {
+            auto &series = series_[id];
+            if (!families_[series.family].start++) need += families_[series.family].size;
+            need += series.size + std::numeric_limits<size_t>::digits10 + 2;
+        }
+        uint32_t position = 0;
+        for (auto &family : families_) {
+            auto count   = family.start;
+            family.start = position;
+            position += count;
+        }
+        order_.resize(samples_.size());
+        for (uint32_t i = 0; i < samples_.size(); i++) order_[families_[series_[samples_[i].first].family].start++] = i;
+
+        if (buffer_.size() < need) buffer_.resize(need);
+        char *out = buffer_.data(), *end = buffer_.data() + buffer_.size();
+        uint32_t family = no_family;
+        for (auto index : order_) {
+            auto [id, value] = samples_[index];
+            auto &series     = series_[id];
+            if (series.family != family) {
+                family = series.family;
+                std::memcpy(out, prefixes_.data() + families_[family].offset, families_[family].size);
+                out += families_[family].size;
+            }
+            std::memcpy(out, prefixes_.data() + series.offset, series.size);
+            out    = std::to_chars(out + series.size, end, value).ptr;
+            *out++ = '\n';
+        }
+        if (format_ == Format::OpenMetrics) {
+            std::memcpy(out, "# EOF\n", 6);
+            out += 6;
+        }
+        return {buffer_.data(), size_t(out - buffer_.data())};
+    }
+
+} // namespace Metrics
@@ -0,0 +1,63 @@
+#pragma once
+#include "Metrics.hpp"
+#include "MetricsSnapshot.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Metrics
+{
+
+    /// Текст Prometheus (text format 0.0.4) или OpenMetrics по снимку или по живым метрикам.
+    /// Префикс серии "name{k="v",...} " с экранированными значениями меток рендерится один раз при первой
+    /// встрече, на такте в переиспользуемый буфер копируются префиксы и форматируется только число.
+    /// Вид семейства берется из суффикса имени: _counter, _gauge, _histogram(_bucket, _sum).
+    /// Не потокобезопасен: свой кодировщик у каждого загрузчика, серии — из одной MetricsModel.
+    class TextEncoder
+    {
+    public:
+        enum class Format { Prometheus, OpenMetrics };
+
+        explicit TextEncoder(Format format = Format::Prometheus) : format_(format) {}
+
+        /// Текст действителен до следующего encode
+        std::string_view encode(const Snapshot &snapshot);
+        /// Для Uploader::upload, вызывать из него, пока копии метрик живы
+        std::string_view encode(const std::set<Metric *> &metrics);
+
+        static std::string_view contentType(Format format);
+        Format format() const { return format_; }
+        size_t bytes() const; /// Кэш префиксов и буфер
+
+    private:
+        static constexpr uint32_t no_family = UINT32_MAX;
+
+        struct Series {
+            uint32_t offset = 0; /// Префикс в prefixes_
+            uint32_t size   = 0;
+            uint32_t family = no_family;
+        };
+        struct Family {
+            uint32_t offset = 0; /// Строка "# TYPE" в prefixes_
+            uint32_t size   = 0;
+            uint32_t start  = 0; /// Начало семейства в order_ на текущем encode
+        };
+
+        const Series &series(uint32_t id, const SeriesKey &key); /// Рендерит префикс при первой встрече серии
+        std::string_view render();                               /// Текст по samples_
+
+        Format format_;
+        std::string prefixes_; /// Арена префиксов и заголовков семейств
+        std::vector<Series> series_;
+        std::vector<Family> families_;
+        std::unordered_map<std::string, uint32_t> family_ids_;
+        std::vector<uint32_t> order_; /// Номера образцов, сгруппированные по семействам
+        std::vector<std::pair<uint32_t, size_t>> samples_; /// (series_id, значение) текущего encode
+        std::string buffer_;
+    };
+
+} // namespace Metrics
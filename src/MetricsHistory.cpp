@@ -0,0 +1,100 @@
+#include "MetricsHistory.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace Metrics
+{
+
+    void History::setDepth(size_t depth)
+    {
+        depth_ = std::min(depth, max_depth);
+        values_.clear();
+        count_.clear();
+        last_tick_.clear();
+    }
+
+    void History::beginTick(size_t series_count)
+    {
+        tick_++;
+        if (!depth_ || series_count <= count_.size()) return;
+        // Рост с запасом, чтобы новые серии не приводили к перевыделению на каждом такте
+        auto capacity = std::max(series_count, count_.size() * 2);
+        values_.resize(capacity * depth_);
+        count_.resize(capacity);
+        last_tick_.resize(capacity);
+    }
+
+    void History::push(uint32_t id, size_t value)
+    {
+        if (!depth_ || id >= count_.size()) return;
+        if (last_tick_[id] != tick_) {
+            // Пропуск такта (метрика пересоздана) обрывает историю
+            count_[id]     = last_tick_[id] + 1 == tick_ ? std::min<size_t>(count_[id] + 1, depth_) : 1;
+            last_tick_[id] = tick_;
+        }
+        values_[id * depth_ + tick_ % depth_] = value;
+    }
+
+    size_t History::size(uint32_t id) const
+    {
+        if (id >= count_.size() || last_tick_[id] != tick_) return 0;
+        return count_[id];
+    }
+
+    size_t History::delta(uint32_t id) const
+    {
+        if (size(id) < 2) return 0;
+        auto current = at(id, 0), previous = at(id, 1);
+        return current >= previous ? current - previous : current;
+    }
+
+    double History::rate(uint32_t id, size_t n) const
+    {
+        n = std::min(n, size(id));
+        if (n < 2) return 0;
+        size_t increase = 0;
+        for (size_t i = 0; i + 1 < n; i++) {
+            auto current = at(id, i), previous = at(id, i + 1);
+            increase += current >= previous ? current - previous : current;
+        }
+        return increase / (interval_ * (n - 1));
+    }
+
+    double History::avg(uint32_t id, size_t n) const
+    {
+        n = std::min(n, size(id));
+        if (!n) return 0;
+        double sum = 0;
+        for (size_t i = 0; i < n; i++) sum += at(id, i);
+        return sum / n;
+    }
+
+    size_t History::min(uint32_t id, size_t n) const
+    {
+        n = std::min(n, size(id));
+        if (!n) return 0;
+        size_t res = at(id, 0);
+        for (size_t i = 1; i < n; i++) res = std::min(res, at(id, i));
+        return res;
+    }
+
+    size_t History::max(uint32_t id, size_t n) const
+    {
+        n = std::min(n, size(id));
+        size_t res = 0;
+        for (size_t i = 0; i < n; i++) res = std::max(res, at(id, i));
+        return res;
+    }
+
+    size_t History::percentile(uint32_t id, double p, size_t n) const
+    {
+        n = std::min(n, size(id));
+        if (!n) return 0;
+        size_t values[max_depth];
+        for (size_t i = 0; i < n; i++) values[i] = at(id, i);
+        size_t rank = p <= 0 ? 0 : std::min(n - 1, static_cast<size_t>(std::ceil(p / 100 * n)) - 1);
+        std::nth_element(values, values + rank, values + n);
+        return values[rank];
+    }
+
+} // namespace Metrics
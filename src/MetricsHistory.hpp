@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <vector>
+
+namespace Metrics
+{
+
+    /// История значений серий за последние depth тактов: кольцевые буферы в одном массиве, индекс — series_id.
+    /// Все серии пишутся в одну позицию кольца за такт, поэтому запись O(1) и без выделений памяти,
+    /// память растет только при появлении новых серий.
+    /// Запись под unique_lock(mutex()), чтение под shared_lock(mutex()).
+    class History
+    {
+    public:
+        static constexpr size_t max_depth = 64;
+
+        void setDepth(size_t depth);
+        size_t depth() const { return depth_; }
+        void setInterval(double seconds) { interval_ = seconds; }
+
+        void beginTick(size_t series_count);
+        void push(uint32_t id, size_t value);
+
+        /// Количество значений серии подряд, не больше depth()
+        size_t size(uint32_t id) const;
+        /// i = 0 — последнее значение
+        size_t at(uint32_t id, size_t i) const { return values_[id * depth_ + (last_tick_[id] - i) % depth_]; }
+
+        /// Прирост между двумя последними значениями, сброс счетчика считается приростом от нуля
+        size_t delta(uint32_t id) const;
+        /// Прирост в секунду за n последних значений
+        double rate(uint32_t id, size_t n) const;
+        double avg(uint32_t id, size_t n) const;
+        size_t min(uint32_t id, size_t n) const;
+        size_t max(uint32_t id, size_t n) const;
+        /// p от 0 до 100 по n последним значениям
+        size_t percentile(uint32_t id, double p, size_t n) const;
+
+        std::shared_mutex &mutex() const { return mutex_; }
+        /// Память под значения всех серий, читать под mutex()
+        size_t bytes() const
+        {
+            return values_.capacity() * sizeof(size_t) + count_.capacity() * sizeof(uint32_t) +
+                   last_tick_.capacity() * sizeof(uint64_t);
+        }
+
+    private:
+        size_t depth_    = 0;
+        double interval_ = 1;
+        uint64_t tick_   = 0;
+        std::vector<size_t> values_;
+        std::vector<uint32_t> count_;
+        std::vector<uint64_t> last_tick_;
+        mutable std::shared_mutex mutex_;
+    };
+
+} // namespace Metrics
@@ -0,0 +1,61 @@
+#include "MetricsImport.hpp"
+
+namespace Metrics
+{
+
+    size_t ImportTable::upsert(std::span<const Import> batch, KeyTable &keys)
+    {
+        size_t accepted  = 0;
+        size_t keys_size = keys.size();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index_.size() < keys_size) index_.resize(keys_size, no_entry);
+        for (auto [id, value] : batch) {
+            if (id >= keys_size) continue;
+            auto &entry = index_[id];
+            if (entry == no_entry) {
+                if (!keys.acquire(id, true)) continue;
+                entry = entries_.size();
+                entries_.push_back({id, generation_, value});
+            } else
+                entries_[entry] = {id, generation_, value};
+            accepted++;
+        }
+        return accepted;
+    }
+
+    size_t ImportTable::expire(uint32_t ttl, KeyTable &keys)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t removed = 0;
+        // Удаление перестановкой последней записи на место удаленной, порядок записей не важен
+        for (size_t i = 0; i < entries_.size();) {
+            if (generation_ - entries_[i].generation < ttl) {
+                i++;
+                continue;
+            }
+            index_[entries_[i].id] = no_entry;
+            keys.release(entries_[i].id);
+            if (i != entries_.size() - 1) {
+                entries_[i]            = entries_.back();
+                index_[entries_[i].id] = i;
+            }
+            entries_.pop_back();
+            removed++;
+        }
+        generation_++;
+        return removed;
+    }
+
+    size_t ImportTable::size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    size_t ImportTable::bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.capacity() * sizeof(Entry) + index_.capacity() * sizeof(uint32_t);
+    }
+
+} // namespace Metrics
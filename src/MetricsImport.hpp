@@ -0,0 +1,56 @@
+#pragma once
+#include "SeriesKeys.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace Metrics
+{
+
+    /// Значение импортированной серии, id — из MetricsModel::importKey
+    struct Import {
+        uint32_t id;
+        size_t value;
+    };
+
+    /// Серии, импортированные из другого хранилища пакетами, без объектов Metric и без реестра.
+    /// Плотный массив записей и индекс series_id -> запись: пакет обновляется под одной блокировкой,
+    /// на серию — два обращения к массивам. Поколение растет с каждым тактом модели, серия, не обновленная
+    /// ttl поколений, удаляется из таблицы; ее ключ остается в KeyTable и переиспользуется при возвращении.
+    /// Запись держит ссылку на серию в KeyTable, поэтому серия учитывается в бюджетах, пока она в таблице.
+    class ImportTable
+    {
+    public:
+        /// Возвращает, сколько значений пакета принято; id вне keys и новые серии сверх бюджета пропускаются
+        size_t upsert(std::span<const Import> batch, KeyTable &keys);
+        /// Начинает новое поколение и удаляет серии старше ttl поколений, возвращает количество удаленных
+        size_t expire(uint32_t ttl, KeyTable &keys);
+
+        /// f(series_id, value) по всем сериям подряд, под блокировкой таблицы
+        template <class F> void forEach(F &&f) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto &entry : entries_) f(entry.id, entry.value);
+        }
+
+        size_t size() const;
+        size_t bytes() const;
+
+    private:
+        static constexpr uint32_t no_entry = UINT32_MAX;
+
+        struct Entry {
+            uint32_t id;
+            uint32_t generation; /// Поколение последнего обновления
+            size_t value;
+        };
+
+        mutable std::mutex mutex_;
+        std::vector<Entry> entries_;
+        std::vector<uint32_t> index_; /// series_id -> номер в entries_
+        uint32_t generation_ = 0;
+    };
+
+} // namespace Metrics
@@ -0,0 +1,100 @@
+#include "MetricsInstrumentation.hpp"
+#if METRICS_SELF_INSTRUMENTATION
+#include <sstream>
+
+namespace Metrics
+{
+
+    namespace
+    {
+        uint64_t elapsedUs(uint64_t start) { return TimerClock::toNanoseconds(TimerClock::now() - start) / 1000; }
+
+        void dumpLine(std::ostringstream &out, const std::string &name, const Histogram &histogram)
+        {
+            out << name << " count=" << histogram.count() << " sum=" << histogram.sum();
+            for (auto [label, q] : {std::pair{" p50=", 0.5}, {" p90=", 0.9}, {" p99=", 0.99}}) {
+                auto value = histogram.quantile(q);
+                out << label;
+                if (value == SIZE_MAX) out << "inf";
+                else out << value;
+            }
+            out << '\n';
+        }
+    } // namespace
+
+    // До ~67 с, две корзины на степень двойки: около 50 серий на гистограмму
+    Histogram::Buckets Instrumentation::buckets() { return Histogram::Buckets::logLinear(size_t(1) << 26, 1); }
+
+    Instrumentation::Instrumentation()
+        : tick_us("MetricsModel_tick_us", buckets()), lock_wait_us("MetricsModel_statistics_lock_wait_us", buckets()),
+          lock_hold_us("MetricsModel_statistics_lock_hold_us", buckets()),
+          alerts_per_tick("MetricsModel_alerts_per_tick", Histogram::Buckets::logLinear(1 << 16, 1)),
+          registry_size("MetricsModel_registry_size")
+    {
+    }
+
+    Instrumentation::~Instrumentation() { registry_size = 0; }
+
+    Histogram &Instrumentation::uploader(const std::string &type)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &histogram = uploaders_[type];
+        if (!histogram)
+            histogram = std::make_unique<Histogram>("MetricsModel_upload_call_us", buckets(),
+                                                    std::vector<Tag>{{"uploader", type}});
+        return *histogram;
+    }
+
+    Histogram &Instrumentation::provider(const std::string &type)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &histogram = providers_[type];
+        if (!histogram)
+            histogram = std::make_unique<Histogram>("MetricsModel_alert_call_us", buckets(),
+                                                    std::vector<Tag>{{"provider", type}});
+        return *histogram;
+    }
+
+    std::string Instrumentation::dump() const
+    {
+        std::ostringstream out;
+        out << "MetricsModel_registry_size " << size_t(registry_size) << '\n';
+        dumpLine(out, "MetricsModel_tick_us", tick_us);
+        dumpLine(out, "MetricsModel_statistics_lock_wait_us", lock_wait_us);
+        dumpLine(out, "MetricsModel_statistics_lock_hold_us", lock_hold_us);
+        dumpLine(out, "MetricsModel_alerts_per_tick", alerts_per_tick);
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &[type, histogram] : uploaders_)
+            dumpLine(out, "MetricsModel_upload_call_us{uploader=" + type + "}", *histogram);
+        for (auto &[type, histogram] : providers_)
+            dumpLine(out, "MetricsModel_alert_call_us{provider=" + type + "}", *histogram);
+        return out.str();
+    }
+
+    TimedLock::TimedLock(std::mutex &mutex, Histogram *wait_us, Histogram *hold_us) : mutex_(mutex), hold_us_(hold_us)
+    {
+        if (!hold_us_) {
+            mutex_.lock();
+            return;
+        }
+        // Без конкуренции часы не читаются дважды: ожидание записывается нулем
+        if (mutex_.try_lock()) {
+            locked_ = TimerClock::now();
+            if (wait_us) wait_us->record(0);
+            return;
+        }
+        auto start = TimerClock::now();
+        mutex_.lock();
+        locked_ = TimerClock::now();
+        if (wait_us) wait_us->record(TimerClock::toNanoseconds(locked_ - start) / 1000);
+    }
+
+    TimedLock::~TimedLock()
+    {
+        auto held = hold_us_ ? elapsedUs(locked_) : 0;
+        mutex_.unlock();
+        if (hold_us_) hold_us_->record(held);
+    }
+
+} // namespace Metrics
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+#include "Metrics.hpp"
+#include "MetricsTimer.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/// Самоинструментирование MetricsModel, выключается при сборке: -DMETRICS_SELF_INSTRUMENTATION=0.
+/// Выключенное не оставляет в модели ни полей, ни вызовов часов
+#ifndef METRICS_SELF_INSTRUMENTATION
+#define METRICS_SELF_INSTRUMENTATION 1
+#endif
+
+/// Код, который собирается только с самоинструментированием
+#if METRICS_SELF_INSTRUMENTATION
+#define METRICS_INSTRUMENT(...) __VA_ARGS__
+#else
+#define METRICS_INSTRUMENT(...)
+#endif
+
+namespace Metrics
+{
+
+#if METRICS_SELF_INSTRUMENTATION
+    /// Гистограммы внутренних операций модели, микросекунды. Это обычные метрики, их выгружают загрузчики,
+    /// а dump() дает их сводку по последнему сбору без загрузчиков
+    class Instrumentation
+    {
+    public:
+        Instrumentation();
+        ~Instrumentation();
+
+        Histogram tick_us;         /// Такт модели целиком
+        Histogram lock_wait_us;    /// Ожидание statistics_mutex_
+        Histogram lock_hold_us;    /// Удержание statistics_mutex_
+        Histogram alerts_per_tick; /// Оповещений за проверку группы правил
+        Gauge registry_size;       /// Метрик в реестре
+
+        /// Время вызовов Uploader::upload/uploadSnapshot и NotifierProvider::alert по типу плагина,
+        /// гистограмма создается при первом запросе и живет до удаления модели
+        Histogram &uploader(const std::string &type);
+        Histogram &provider(const std::string &type);
+
+        /// Строка на гистограмму: имя, count, sum, p50, p90, p99
+        std::string dump() const;
+
+    private:
+        static Histogram::Buckets buckets();
+        mutable std::mutex mutex_; /// Защищает uploaders_ и providers_
+        std::map<std::string, std::unique_ptr<Histogram>> uploaders_, providers_;
+    };
+
+    /// lock_guard, записывающий ожидание и удержание мьютекса; без гистограмм — обычный lock_guard
+    class TimedLock
+    {
+    public:
+        TimedLock(std::mutex &mutex, Histogram *wait_us, Histogram *hold_us);
+        ~TimedLock();
+        TimedLock(const TimedLock &)            = delete;
+        TimedLock &operator=(const TimedLock &) = delete;
+
+    private:
+        std::mutex &mutex_;
+        Histogram *hold_us_;
+        uint64_t locked_ = 0;
+    };
+#endif
+
+} // namespace Metrics
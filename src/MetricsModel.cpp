@@ -1,30 +1,182 @@
 #include "MetricsModel.hpp"
 #include "NotifierSystem.hpp"
 #include <PluginCore/Logger/Log>
+#include <boost/core/demangle.hpp>
+#include <algorithm>
 #include <sys/prctl.h>
 #include <chrono>
+#include <filesystem>
+#include <thread>
+
+MetricsModel::UploaderState::UploaderState(Metrics::Uploader *uploader, boost::asio::io_context &io)
+    : strand(boost::asio::make_strand(io))
+{
+    std::vector<Metrics::Tag> tags = {{"uploader", boost::core::demangle(typeid(*uploader).name())}};
+    upload_us = std::make_unique<Metrics::Gauge>("MetricsModel_upload_us", tags, Metrics::Mode::Sharded);
+    lag_us    = std::make_unique<Metrics::Gauge>("MetricsModel_upload_lag_us", tags, Metrics::Mode::Sharded);
+    dropped   = std::make_unique<Metrics::Counter>("MetricsModel_upload_dropped", tags);
+    samples   = std::make_unique<Metrics::Gauge>("MetricsModel_upload_samples", tags, Metrics::Mode::Sharded);
+}
+
+MetricsModel::UploaderState::~UploaderState()
+{
+    *upload_us = 0;
+    *lag_us    = 0;
+    *samples   = 0;
+}
 
 void MetricsModel::unregisterUploader(Metrics::Uploader *uploader)
 {
-    std::lock_guard<std::mutex> lock(statistics_mutex_);
-    uploaders_.erase(uploader);
+    std::shared_ptr<UploaderState> state;
+    {
+        auto lock = lockStatistics();
+        auto it = uploaders_.find(uploader);
+        if (it == uploaders_.end()) return;
+        state = std::move(it->second);
+        uploaders_.erase(it);
+    }
+    // Загрузчик будет удален сразу после выхода, дожидаемся уже отправленных ему тактов. Ждем и последнюю
+    // ссылку обработчика: метрики состояния удаляются здесь, а не в io-потоке, где удаление ждало бы
+    // Registry::Walk такта, стоящего в очереди за ним
+    while (state.use_count() > 1) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+MetricsModel::StatisticsLock MetricsModel::lockStatistics()
+{
+#if METRICS_SELF_INSTRUMENTATION
+    if (instruments_) return {statistics_mutex_, &instruments_->lock_wait_us, &instruments_->lock_hold_us};
+    return {statistics_mutex_, nullptr, nullptr};
+#else
+    return StatisticsLock(statistics_mutex_);
+#endif
+}
+
+std::string MetricsModel::debugDump() const
+{
+#if METRICS_SELF_INSTRUMENTATION
+    if (instruments_) return instruments_->dump();
+#endif
+    return "";
 }
 
 void MetricsModel::registerUploader(Metrics::Uploader *uploader)
 {
-    std::lock_guard<std::mutex> lock(statistics_mutex_);
-    uploaders_.insert(uploader);
-    uploader->io = &io_;
+    auto state = std::make_shared<UploaderState>(uploader, io_);
+    METRICS_INSTRUMENT(if (instruments_) state->call_us =
+                           &instruments_->uploader(boost::core::demangle(typeid(*uploader).name()));)
+    std::weak_ptr<UploaderState> weak = state;
+    {
+        auto lock = lockStatistics();
+        uploaders_.emplace(uploader, std::move(state));
+        uploader->io = &io_;
+    }
+    if (!uploader->interval_ms) return;
+    // Расписание заканчивается само, когда загрузчик снят с регистрации
+    scheduler_.add("uploader " + boost::core::demangle(typeid(*uploader).name()),
+                   scheduleOptions(std::chrono::milliseconds(uploader->interval_ms)),
+                   [this, uploader, weak](std::chrono::milliseconds, const Metrics::Scheduler::Pending &pending) {
+                       return uploaderTick(uploader, weak, pending);
+                   });
+}
+
+void MetricsModel::collect(bool with_history)
+{
+    Metrics::Registry::Walk walk(registry_);
+    if (values_.enabled()) return collectStore(with_history);
+    if (!history_.depth() || !with_history) {
+        registry_.forEach([](Metrics::Metric *metric) { metric->collect(); });
+        return;
+    }
+    // Histogram выставляет значения своих серий корзин при сборе, поэтому история пишется вторым проходом
+    registry_.forEach([](Metrics::Metric *metric) { metric->collect(); });
+    std::unique_lock<std::shared_mutex> lock(history_.mutex());
+    history_.beginTick(keys_.size());
+    registry_.forEach([this](Metrics::Metric *metric) { history_.push(metric->series_id, metric->loadValue()); });
+    imports_.forEach([this](uint32_t id, size_t value) { history_.push(id, value); });
+}
+
+void MetricsModel::collectMerged()
+{
+    if (values_.enabled()) return collect(false);
+    Metrics::Registry::Walk walk(registry_);
+    if (merge_version_ != registry_.version()) {
+        merge_version_ = registry_.version();
+        merge_slots_.clear();
+        // Plain Counter, Gauge и Bool пишут прямо в value_, им нечего сливать
+        for (uint32_t slot = 0; slot < registry_.top(); slot++)
+            if (auto metric = registry_.at(slot); metric && (metric->shards_ || !metric->direct_))
+                merge_slots_.push_back(slot);
+    }
+    for (auto slot : merge_slots_)
+        if (auto metric = registry_.at(slot)) metric->collect();
+}
+
+void MetricsModel::collectStore(bool with_history)
+{
+    // Объекты Metric читаются только для метрик без своей ячейки, остальное — линейные проходы по блокам
+    values_.refresh(registry_);
+    auto &list = values_.collectList();
+    for (auto slot : list)
+        if (auto metric = registry_.at(slot)) metric->collect();
+    for (auto slot : list)
+        if (auto metric = registry_.at(slot)) values_.set(slot, metric->loadValue());
+    if (!history_.depth() || !with_history) return;
+    std::unique_lock<std::shared_mutex> lock(history_.mutex());
+    history_.beginTick(keys_.size());
+    values_.forEach([this](uint32_t id, uint8_t, size_t value) { history_.push(id, value); });
+    imports_.forEach([this](uint32_t id, size_t value) { history_.push(id, value); });
+}
+
+std::shared_ptr<const Metrics::Snapshot> MetricsModel::takeSnapshot(bool track_changes)
+{
+    auto snapshot  = std::make_shared<Metrics::Snapshot>();
+    snapshot->keys = &keys_;
+    snapshot->time = std::chrono::system_clock::now();
+    snapshot->tick = ++snapshot_tick_;
+    snapshot->samples.reserve(registry_.size() + imports_.size());
+    auto start = std::chrono::steady_clock::now();
+    if (values_.enabled())
+        values_.forEach([&](uint32_t id, uint8_t flags, size_t value) {
+            snapshot->samples.push_back({id, bool(flags & Metrics::ValueStore::imported), value});
+        });
+    else {
+        Metrics::Registry::Walk walk(registry_);
+        registry_.forEach([&](Metrics::Metric *metric) {
+            snapshot->samples.push_back({metric->series_id, metric->imported, metric->loadValue()});
+        });
+    }
+    imports_.forEach([&](uint32_t id, size_t value) { snapshot->samples.push_back({id, true, value}); });
+    if (track_changes) {
+        // Две метрики с одним ключом делят series_id: при разных значениях серия просто считается измененной
+        last_values_.resize(keys_.size());
+        changed_tick_.resize(keys_.size());
+        snapshot->changed.resize(snapshot->samples.size());
+        for (size_t i = 0; i < snapshot->samples.size(); i++) {
+            auto &sample = snapshot->samples[i];
+            if (!changed_tick_[sample.id] || last_values_[sample.id] != sample.value) {
+                changed_tick_[sample.id] = snapshot->tick;
+                last_values_[sample.id]  = sample.value;
+            }
+            snapshot->changed[i] = changed_tick_[sample.id];
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (self_metrics_.snapshot_lock_us)
+        *self_metrics_.snapshot_lock_us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    return snapshot;
 }
 
 void MetricsModel::run()
 {
     prctl(PR_SET_NAME, "MetricsModel", 0, 0, 0);
-    upload_timer_.expires_after(std::chrono::seconds(config.statisticInterval.value));
-    upload_timer_.async_wait(std::bind(&MetricsModel::timer_handler, this, std::placeholders::_1));
     io_.run();
 }
 
+Metrics::Scheduler::Options MetricsModel::scheduleOptions(std::chrono::milliseconds interval) const
+{
+    return {interval, config.tickBudgetPercent, config.maxSlowdown};
+}
+
 void MetricsModel::registerArgs(d3156::Args::Builder &bldr) { bldr.setVersion(FULL_NAME); }
 
 MetricsModel::~MetricsModel()
@@ -33,53 +185,353 @@ MetricsModel::~MetricsModel()
         stopToken = true;
         io_guard.reset();
         G_LOG(1, "Io-context guard canceled");
-        upload_timer_.cancel();
-        G_LOG(1, "Metrics timer canceled");
-        if (!thread_.joinable()) return;
-        G_LOG(1, "Thread joinable, try join in " << config.stopThreadTimeout << " milliseconds");
-        if (thread_.timed_join(boost::chrono::milliseconds(config.stopThreadTimeout.value))) return;
+        scheduler_.stop();
+        G_LOG(1, "Metrics timers canceled");
+        auto join = [this] {
+            bool joined = true;
+            for (auto &thread : threads_)
+                if (thread.joinable() && !thread.timed_join(boost::chrono::milliseconds(config.stopThreadTimeout.value)))
+                    joined = false;
+            // Метрики StaticCounter переживают модель, их Metric удаляются, когда такты уже не выполняются
+            if (joined) Metrics::StaticNode::releaseAll();
+            return joined;
+        };
+        if (threads_.empty() && join()) return;
+        G_LOG(1, "Threads joinable, try join in " << config.stopThreadTimeout << " milliseconds");
+        if (join()) return;
         Y_LOG(1, "Metrics upload thread was not terminated, attempting to force stop io_context...");
         io_.stop();
-        if (thread_.timed_join(boost::chrono::milliseconds(config.stopThreadTimeout.value))) {
+        if (join()) {
             G_LOG(1, "io_context force stopped successfully");
             return;
         }
         R_LOG(1, "WARNING: Metrics upload thread cannot be stopped. Thread will be detached (potential resource leak)");
-        thread_.detach();
-        std::lock_guard<std::mutex> lock(statistics_mutex_);
-        for (auto i : metrics_) i->parent = nullptr;
+        for (auto &thread : threads_)
+            if (thread.joinable()) thread.detach();
+        Metrics::Registry::Walk walk(registry_);
+        registry_.forEach([](Metrics::Metric *metric) { metric->parent = nullptr; });
     } catch (std::exception &e) {
         R_LOG(1, "Exception throwed in exit: " << e.what());
     }
 }
 
-void MetricsModel::timer_handler(const boost::system::error_code &ec)
+MetricsModel::SelfMetrics::~SelfMetrics()
+{
+    for (auto gauge :
+         {&snapshot_lock_us, &series_count, &series_key_bytes, &history_bytes, &registry_bytes, &persist_us,
+          &import_series})
+        if (*gauge) **gauge = 0;
+    for (auto &name : published_names) series_per_name->withLabels(name) = 0;
+}
+
+MetricsModel::MemoryUsage MetricsModel::memoryUsage() const
+{
+    MemoryUsage usage;
+    usage.keys     = keys_.bytes();
+    usage.registry = registry_.bytes() + values_.bytes();
+    usage.imports  = imports_.bytes();
+    usage.alerts   = notifier_manager.state_bytes;
+    std::shared_lock<std::shared_mutex> lock(history_.mutex());
+    usage.history = history_.bytes();
+    return usage;
+}
+
+Metrics::Metric *MetricsModel::overflowSeries(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(overflow_mutex_);
+    auto &series = overflow_series_[name];
+    if (!series) {
+        Y_LOG(1, "Series budget exceeded for " << name << ", new series collapse into " << Metrics::overflow_tag.first);
+        series = std::make_unique<Metrics::Metric>(name, std::vector<Metrics::Tag>{Metrics::overflow_tag},
+                                                   Metrics::Mode::Sharded);
+    }
+    return series.get();
+}
+
+void MetricsModel::importBatch(std::span<const Metrics::Import> batch)
+{
+    auto accepted = imports_.upsert(batch, keys_);
+    if (accepted != batch.size() && self_metrics_.import_dropped) *self_metrics_.import_dropped += batch.size() - accepted;
+}
+
+void MetricsModel::publishSeriesStats()
+{
+    auto usage                      = memoryUsage();
+    *self_metrics_.series_count     = keys_.size();
+    *self_metrics_.series_key_bytes = usage.keys;
+    *self_metrics_.history_bytes    = usage.history;
+    *self_metrics_.registry_bytes   = usage.registry;
+    if (!config.topSeriesNames) return;
+    std::set<std::string> published;
+    for (auto &[name, count] : keys_.seriesPerName(config.topSeriesNames)) {
+        self_metrics_.series_per_name->withLabels(name) = count;
+        published.insert(name);
+    }
+    // Имена, выпавшие из топа, обнуляются, чтобы не показывать устаревшее значение
+    for (auto &name : self_metrics_.published_names)
+        if (!published.count(name)) self_metrics_.series_per_name->withLabels(name) = 0;
+    self_metrics_.published_names.merge(published);
+}
+
+void MetricsModel::uploadChanges(Metrics::Uploader &uploader, UploaderState &state, const Metrics::Snapshot &snapshot)
+{
+    bool full = !state.synced || snapshot.changed.size() != snapshot.samples.size() ||
+                snapshot.tick - state.resync_tick >= std::max<size_t>(uploader.resync_every, 1);
+    if (full) {
+        // Пока полная выгрузка не удалась, следующая тоже будет полной
+        state.synced   = false;
+        *state.samples = snapshot.samples.size();
+        uploader.uploadSnapshot(snapshot);
+        state.resync_tick = snapshot.tick;
+        state.synced      = true;
+    } else {
+        // Ошибка оставляет курсор на месте, и следующий частичный снимок повторит эти изменения
+        Metrics::Snapshot changes;
+        changes.keys = snapshot.keys;
+        changes.time = snapshot.time;
+        changes.tick = snapshot.tick;
+        changes.full = false;
+        for (size_t i = 0; i < snapshot.samples.size(); i++)
+            if (snapshot.changed[i] > state.cursor) changes.samples.push_back(snapshot.samples[i]);
+        *state.samples = changes.samples.size();
+        uploader.uploadSnapshot(changes);
+    }
+    state.cursor = snapshot.tick;
+}
+
+void MetricsModel::loadPersisted()
 {
-    if (ec && ec != boost::asio::error::operation_aborted) R_LOG(1, ec.message());
-    if (ec || stopToken) return;
+    auto &path = config.persistFile.value;
+    if (!std::filesystem::exists(path)) {
+        G_LOG(1, "No metrics snapshot " << path << ", counters start from zero");
+        return;
+    }
     try {
+        auto start = std::chrono::steady_clock::now();
+        auto file  = std::make_unique<Metrics::SnapshotFile>();
+        file->open(path);
+        restored_file_ = std::move(file);
+        restored_.store(restored_file_.get(), std::memory_order_release);
+        notifier_manager.restored = restored_file_.get();
+        // Метрики, созданные до загрузки; созданные после восстанавливаются в Metric::attach
+        Metrics::Registry::Walk walk(registry_);
+        registry_.forEach([this](Metrics::Metric *metric) {
+            if (metric->direct_) restore(*metric);
+        });
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        G_LOG(1, "Restored metrics snapshot " << path << ": " << restored_file_->size() << " series in "
+                                              << elapsed.count() << " ms");
+    } catch (std::exception &e) {
+        R_LOG(1, "Metrics snapshot is not restored: " << e.what());
+    }
+}
+
+void MetricsModel::restore(Metrics::Metric &metric)
+{
+    auto file = restored_.load(std::memory_order_acquire);
+    if (!file || !keys_[metric.series_id].name.ends_with("_counter")) return;
+    auto value = file->claim(keys_[metric.series_id]);
+    if (!value) return;
+    if (metric.shards_)
+        metric.shards_->add(*value);
+    else if (metric.cell_)
+        metric.cell_->fetch_add(*value, std::memory_order_relaxed);
+    else
+        metric.storeValue(metric.loadValue() + *value);
+}
+
+void MetricsModel::persist(const Metrics::Snapshot &snapshot)
+{
+    try {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Metrics::SnapshotFile::Alert> alerts;
         {
-            std::lock_guard<std::mutex> lock(statistics_mutex_);
-            for (auto &uploader : uploaders_)
-                if (uploader) uploader->upload(metrics_);
+            // Привязки правил читают объекты Metric; значения уже в снимке, файл пишется без обхода
+            Metrics::Registry::Walk walk(registry_);
+            alerts = notifier_manager.exportAlerts(registry_);
+        }
+        Metrics::SnapshotFile::write(config.persistFile.value, snapshot, alerts);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        if (self_metrics_.persist_us)
+            *self_metrics_.persist_us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    } catch (std::exception &e) {
+        R_LOG(1, "Exception throwed in persist: " << e.what());
+    }
+}
+
+void MetricsModel::dispatchUpload(Metrics::Uploader *uploader, const std::shared_ptr<UploaderState> &state,
+                                  std::shared_ptr<const Metrics::Snapshot> snapshot,
+                                  std::chrono::steady_clock::time_point tick_time,
+                                  const Metrics::Scheduler::Pending &pending)
+{
+    if (state->in_flight >= std::max<size_t>(config.uploaderInFlight, 1)) {
+        (*state->dropped)++;
+        return;
+    }
+    state->in_flight++;
+    boost::asio::post(state->strand, [uploader = uploader, state = state, snapshot, tick_time, pending] {
+        auto start     = std::chrono::steady_clock::now();
+        *state->lag_us = std::chrono::duration_cast<std::chrono::microseconds>(start - tick_time).count();
+        try {
+            METRICS_INSTRUMENT(std::optional<Metrics::ScopedTimer<Metrics::Histogram>> timer;
+                               if (state->call_us) timer.emplace(*state->call_us);)
+            if (uploader->use_snapshot && uploader->changes_only)
+                uploadChanges(*uploader, *state, *snapshot);
+            else {
+                // Без use_snapshot — реализация Uploader по умолчанию: upload() с копиями метрик снимка
+                *state->samples = snapshot->samples.size();
+                uploader->uploadSnapshot(*snapshot);
+            }
+        } catch (std::exception &e) {
+            R_LOG(1, "Exception throwed in upload: " << e.what());
+        }
+        auto elapsed      = std::chrono::steady_clock::now() - start;
+        *state->upload_us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        state->in_flight--;
+    });
+}
+
+bool MetricsModel::postNotify(size_t group, std::shared_ptr<const Metrics::Snapshot> snapshot, bool persist,
+                              const Metrics::Scheduler::Pending &pending)
+{
+    if (notifier_busy_[group].exchange(true)) return false;
+    boost::asio::post(notifier_strand_, [this, group, snapshot, persist, pending] {
+        try {
+            std::lock_guard<std::mutex> lock(providers_mutex_);
+            NotifierSystem::NotifyManager::Messages messages;
+            {
+                Metrics::Registry::Walk walk(registry_);
+                messages = notifier_manager.upload(registry_, history_, group);
+            }
+            METRICS_INSTRUMENT(if (instruments_) instruments_->alerts_per_tick.record(messages.alerts.size());)
+            for (auto &[provider, queue] : alert_queues_) {
+                queue->push(messages.alerts);
+                if (!messages.report.empty()) queue->push({messages.report});
+            }
+        } catch (std::exception &e) {
+            R_LOG(1, "Exception throwed in notifier: " << e.what());
         }
-        notifier_manager.upload(metrics_);
+        if (persist) this->persist(*snapshot);
+        notifier_busy_[group] = false;
+    });
+    return true;
+}
+
+bool MetricsModel::uploaderTick(Metrics::Uploader *uploader, const std::weak_ptr<UploaderState> &weak,
+                                const Metrics::Scheduler::Pending &pending)
+{
+    if (stopToken) return false;
+    auto tick_time = std::chrono::steady_clock::now();
+    auto lock = lockStatistics();
+    auto it = uploaders_.find(uploader);
+    if (it == uploaders_.end() || it->second != weak.lock()) return false;
+    if (it->second->in_flight >= std::max<size_t>(config.uploaderInFlight, 1)) {
+        (*it->second->dropped)++;
+        return true;
+    }
+    collectMerged();
+    auto snapshot = takeSnapshot(std::ranges::any_of(uploaders_, [](auto &uploader) {
+        return uploader.first->use_snapshot && uploader.first->changes_only;
+    }));
+    dispatchUpload(uploader, it->second, std::move(snapshot), tick_time, pending);
+    return true;
+}
+
+bool MetricsModel::timer_handler(std::chrono::milliseconds period, const Metrics::Scheduler::Pending &pending)
+{
+    if (stopToken) return false;
+    METRICS_INSTRUMENT(Metrics::ScopedTimer<Metrics::Histogram> tick_timer(instruments_->tick_us);
+                       instruments_->registry_size = registry_.size();)
+    try {
+        auto tick_time = std::chrono::steady_clock::now();
+        publishSeriesStats();
+        Metrics::StaticNode::mirrorAll(static_version_);
+        if (config.importTtl) *self_metrics_.import_expired += imports_.expire(config.importTtl, keys_);
+        *self_metrics_.import_series = imports_.size();
+        auto lock = lockStatistics();
+        std::shared_ptr<const Metrics::Snapshot> snapshot;
+        if (period != history_period_) {
+            // Период меняется при замедлении расписания, rate() считается по текущему
+            std::unique_lock<std::shared_mutex> history_lock(history_.mutex());
+            history_.setInterval(period.count() / 1000.0);
+            history_period_ = period;
+        }
+        collect();
+        auto on_tick = [](auto &uploader) { return !uploader.first->interval_ms; };
+        bool persist =
+            !config.persistFile.value.empty() && ++persist_ticks_ >= std::max<size_t>(config.persistInterval, 1);
+        if (persist || std::ranges::any_of(uploaders_, on_tick))
+            snapshot = takeSnapshot(std::ranges::any_of(uploaders_, [](auto &uploader) {
+                return uploader.first->use_snapshot && uploader.first->changes_only;
+            }));
+        bool notify    = !notifier_busy_[0];
+        // Состояние оповещений читается в strand NotifyManager, пропущенный такт переносит запись на следующий
+        if ((persist = persist && notify)) persist_ticks_ = 0;
+        for (auto &[uploader, state] : uploaders_)
+            if (!uploader->interval_ms) dispatchUpload(uploader, state, snapshot, tick_time, pending);
+        if (!notify || !postNotify(0, snapshot, persist, pending)) (*self_metrics_.notify_dropped)++;
     } catch (std::exception &e) {
         R_LOG(1, "Exception throwed in timer_handler: " << e.what());
     }
-    if (stopToken) return;
-    upload_timer_.expires_after(std::chrono::seconds(config.statisticInterval.value));
-    upload_timer_.async_wait(std::bind(&MetricsModel::timer_handler, this, std::placeholders::_1));
+    return !stopToken;
+}
+
+bool MetricsModel::notifyTick(size_t group, const Metrics::Scheduler::Pending &pending)
+{
+    if (stopToken) return false;
+    // Серии группы собирает сама проверка в strand NotifyManager, после привязки правил
+    if (!postNotify(group, nullptr, false, pending)) (*self_metrics_.notify_dropped)++;
+    return true;
 }
 
 void MetricsModel::postInit()
 {
+    if (config.valueStore) values_.enable();
+    self_metrics_.snapshot_lock_us = std::make_unique<Metrics::Gauge>("MetricsModel_snapshot_lock_us");
+    self_metrics_.notify_dropped   = std::make_unique<Metrics::Counter>("MetricsModel_notify_dropped");
+    self_metrics_.series_count     = std::make_unique<Metrics::Gauge>("MetricsModel_series_count");
+    self_metrics_.series_key_bytes = std::make_unique<Metrics::Gauge>("MetricsModel_series_key_bytes");
+    self_metrics_.history_bytes    = std::make_unique<Metrics::Gauge>("MetricsModel_history_bytes");
+    self_metrics_.registry_bytes   = std::make_unique<Metrics::Gauge>("MetricsModel_registry_bytes");
+    self_metrics_.series_overflow =
+        std::make_unique<Metrics::Counter>("MetricsModel_series_overflow", std::vector<Metrics::Tag>{}, Metrics::Mode::Sharded);
+    self_metrics_.series_per_name = std::make_unique<Metrics::MetricFamily<Metrics::Gauge>>(
+        "MetricsModel_series_per_name", std::vector<std::string>{"metric"}, std::max<size_t>(config.topSeriesNames * 4, 1));
+    self_metrics_.persist_us       = std::make_unique<Metrics::Gauge>("MetricsModel_persist_us");
+    self_metrics_.import_series    = std::make_unique<Metrics::Gauge>("MetricsModel_import_series");
+    self_metrics_.import_expired   = std::make_unique<Metrics::Counter>("MetricsModel_import_expired");
+    self_metrics_.import_dropped =
+        std::make_unique<Metrics::Counter>("MetricsModel_import_dropped", std::vector<Metrics::Tag>{}, Metrics::Mode::Sharded);
+    keys_.setLimits(config.maxSeries, config.maxSeriesPerName);
+    if (!config.persistFile.value.empty()) loadPersisted();
+    Metrics::StaticNode::mirrorAll(static_version_);
+    notifier_manager.keys      = &keys_;
+    notifier_manager.state_ttl = config.alertStateTtl;
     notifier_manager.init();
-    thread_ = boost::thread([this]() { this->run(); });
+    history_.setDepth(std::max<size_t>(config.historyDepth, notifier_manager.historyDepth()));
+    auto interval = config.statisticIntervalMs ? std::chrono::milliseconds(config.statisticIntervalMs)
+                                               : std::chrono::milliseconds(config.statisticInterval * 1000);
+    history_.setInterval(interval.count() / 1000.0);
+    history_period_ = interval;
+    auto groups     = notifier_manager.groupIntervals();
+    notifier_busy_  = std::make_unique<std::atomic<bool>[]>(groups.size());
+    scheduler_.add("model", scheduleOptions(interval),
+                   [this](std::chrono::milliseconds period, const Metrics::Scheduler::Pending &pending) {
+                       return timer_handler(period, pending);
+                   });
+    for (size_t group = 1; group < groups.size(); group++)
+        scheduler_.add("notify " + std::to_string(groups[group]) + "ms",
+                       scheduleOptions(std::chrono::milliseconds(groups[group])),
+                       [this, group](std::chrono::milliseconds, const Metrics::Scheduler::Pending &pending) {
+                           return notifyTick(group, pending);
+                       });
+    for (size_t i = 0; i < std::max<size_t>(config.ioThreads, 1); i++)
+        threads_.emplace_back([this]() { this->run(); });
 }
 
 void MetricsModel::init() {
     instance() = this;
+    METRICS_INSTRUMENT(instruments_ = std::make_unique<Metrics::Instrumentation>();)
 }
 
 MetricsModel *&MetricsModel::instance()
@@ -92,14 +544,50 @@ boost::asio::io_context &MetricsModel::getIO() { return io_; }
 
 void MetricsModel::registerAlertProvider(NotifierSystem::NotifierProvider *alert_provider)
 {
-    std::lock_guard<std::mutex> lock(statistics_mutex_);
+    auto queue = std::make_shared<NotifierSystem::AlertQueue>(
+        alert_provider, io_,
+        NotifierSystem::AlertQueue::Limits{config.alertQueue, config.alertBatch, config.alertRatePerMinute});
+    METRICS_INSTRUMENT(if (instruments_) queue->call_us = &instruments_->provider(
+                           boost::core::demangle(typeid(*alert_provider).name()));)
+    // Метрики закрытых очередей удаляются после снятия блокировки, в этом потоке
+    std::vector<std::shared_ptr<NotifierSystem::AlertQueue>> finished;
+    std::lock_guard<std::mutex> lock(providers_mutex_);
     notifier_manager.alert_providers.insert(alert_provider);
+    alert_queues_.emplace(alert_provider, std::move(queue));
+    finished = takeFinishedQueues();
 }
 
 void MetricsModel::unregisterAlertProvider(NotifierSystem::NotifierProvider *alert_provider)
 {
-    std::lock_guard<std::mutex> lock(statistics_mutex_);
-    notifier_manager.alert_providers.erase(alert_provider);
+    std::shared_ptr<NotifierSystem::AlertQueue> queue;
+    std::vector<std::shared_ptr<NotifierSystem::AlertQueue>> finished;
+    {
+        std::lock_guard<std::mutex> lock(providers_mutex_);
+        notifier_manager.alert_providers.erase(alert_provider);
+        finished = takeFinishedQueues();
+        auto it = alert_queues_.find(alert_provider);
+        if (it == alert_queues_.end()) return;
+        queue = std::move(it->second);
+        alert_queues_.erase(it);
+    }
+    queue->close();
+    // Обработчики, еще стоящие в strand, провайдера не вызовут. Очередь с их ссылками не ждем: из io-потока
+    // они не выполнились бы никогда. Ее метрики удаляются не в strand — удаление ждало бы Registry::Walk
+    // такта, стоящего в очереди за ним
+    if (queue.use_count() == 1) return;
+    std::lock_guard<std::mutex> lock(providers_mutex_);
+    retired_queues_.push_back(std::move(queue));
+}
+
+std::vector<std::shared_ptr<NotifierSystem::AlertQueue>> MetricsModel::takeFinishedQueues()
+{
+    if (io_.get_executor().running_in_this_thread()) return {};
+    auto running = std::partition(retired_queues_.begin(), retired_queues_.end(),
+                                  [](auto &queue) { return queue.use_count() > 1; });
+    std::vector<std::shared_ptr<NotifierSystem::AlertQueue>> finished(std::make_move_iterator(running),
+                                                                      std::make_move_iterator(retired_queues_.end()));
+    retired_queues_.erase(running, retired_queues_.end());
+    return finished;
 }
 
 std::string MetricsModel::name() { return FULL_NAME; }
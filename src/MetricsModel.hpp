@@ -1,7 +1,18 @@
 #pragma once
+#include "AlertQueue.hpp"
+#include "MetricFamily.hpp"
 #include "MetricUploader.hpp"
 #include "Metrics.hpp"
+#include "MetricsHistory.hpp"
+#include "MetricsImport.hpp"
+#include "MetricsInstrumentation.hpp"
+#include "MetricsRegistry.hpp"
+#include "MetricsScheduler.hpp"
+#include "MetricsSnapshot.hpp"
+#include "MetricsSnapshotFile.hpp"
+#include "MetricsValueStore.hpp"
 #include "NotifierSystem.hpp"
+#include "StaticMetrics.hpp"
 #include <PluginCore/IModel>
 #include <boost/thread.hpp>
 #include <boost/asio.hpp>
@@ -11,9 +22,12 @@ get in registerModels:
     MetricsModel::instance() = models.registerModel<MetricsModel>();
 */
 
+struct MetricsModelProbe;
+
 class MetricsModel final : public d3156::PluginCore::IModel
 {
     friend class Metrics::Metric;
+    friend struct ::MetricsModelProbe; /// bench/: такт и проверка правил без io-потоков
 
 public:
     /// Service interface
@@ -30,6 +44,8 @@ public:
 
     void registerAlertProvider(NotifierSystem::NotifierProvider *alert_provider);
 
+    /// После возврата провайдер больше не вызывается. Ждет только alert(), уже идущий в другом потоке, поэтому
+    /// безопасен и в потоках io_context; из alert() самого провайдера возвращается сразу
     void unregisterAlertProvider(NotifierSystem::NotifierProvider *alert_provider);
 
     static MetricsModel *&instance();
@@ -38,28 +54,187 @@ public:
 
     boost::asio::io_context &getIO();
 
+    /// Ключ серии для importBatch, интернируется один раз на серию; KeyTable::no_id — сверх бюджета серий.
+    /// В бюджетах серия учитывается, пока она есть в таблице импорта
+    uint32_t importKey(std::string_view name, const std::vector<Metrics::Tag> &tags)
+    {
+        auto id = keys_.intern(name, tags, true).id;
+        if (id != Metrics::KeyTable::no_id) keys_.release(id);
+        return id;
+    }
+    /// Значения импортированных серий одним вызовом, без объектов Metric: одна блокировка на пакет.
+    /// Серии попадают в снимки с imported = true и в историю; серия, не обновленная importTtl тактов, удаляется
+    void importBatch(std::span<const Metrics::Import> batch);
+
+    /// История значений серий по series_id, читать под std::shared_lock(history().mutex())
+    const Metrics::History &history() const { return history_; }
+
+    /// Примерная память модели по частям, байты
+    struct MemoryUsage {
+        size_t keys     = 0; /// Ключи серий, теги и индексы KeyTable
+        size_t history  = 0;
+        size_t registry = 0;
+        size_t imports  = 0; /// Таблица importBatch
+        size_t alerts   = 0; /// Состояния оповещений по сериям
+        size_t total() const { return keys + history + registry + imports + alerts; }
+    };
+    MemoryUsage memoryUsage() const;
+    /// Сводка самоинструментирования по последнему сбору, пусто без METRICS_SELF_INSTRUMENTATION
+    std::string debugDump() const;
+    /// Имена с наибольшим количеством серий, по убыванию
+    std::vector<std::pair<std::string, size_t>> seriesPerName(size_t limit = SIZE_MAX) const
+    {
+        return keys_.seriesPerName(limit);
+    }
+
     struct MetricsConfig : public d3156::Config {
         MetricsConfig() : d3156::Config("") {}
         CONFIG_UINT(statisticInterval, 5);
+        CONFIG_UINT(statisticIntervalMs, 0); /// Если не 0: такт модели в миллисекундах вместо statisticInterval
+        CONFIG_UINT(tickBudgetPercent, 0);   /// Доля периода на такт, сверх нее период удваивается; 0 — не замедлять
+        CONFIG_UINT(maxSlowdown, 8);         /// Во сколько раз не больше замедляется расписание
         CONFIG_UINT(stopThreadTimeout, 200);
+        CONFIG_UINT(ioThreads, 1);        /// Потоки io_context: загрузчики и оповещения выполняются параллельно
+        CONFIG_UINT(uploaderInFlight, 1); /// Сколько тактов одного загрузчика может выполняться одновременно
+        CONFIG_UINT(historyDepth, 0);     /// Тактов истории на серию, увеличивается до нужной функциям условий
+        CONFIG_UINT(maxSeries, 0);        /// Бюджет серий на процесс, 0 — без ограничения
+        CONFIG_UINT(maxSeriesPerName, 0); /// Бюджет серий на одно имя метрики, 0 — без ограничения
+        CONFIG_UINT(topSeriesNames, 10);  /// Сколько имен с наибольшим числом серий публиковать в self-метриках
+        CONFIG_BOOL(valueStore, false);   /// Значения Counter, Gauge и Bool в непрерывных блоках Metrics::ValueStore
+        CONFIG_STRING(persistFile, "");   /// Файл Metrics::SnapshotFile: счетчики и оповещения переживают перезапуск
+        CONFIG_UINT(persistInterval, 12); /// Тактов между сохранениями persistFile
+        CONFIG_UINT(importTtl, 3);        /// Тактов без обновления до удаления серии importBatch, 0 — не удалять
+        CONFIG_UINT(alertQueue, 100);       /// Сообщений в очереди одного провайдера оповещений
+        CONFIG_UINT(alertBatch, 50);        /// Оповещений одного такта в одном сообщении
+        CONFIG_UINT(alertRatePerMinute, 0); /// Сообщений в минуту на провайдера, 0 — без ограничения
+        CONFIG_UINT(alertStateTtl, 60);     /// Тактов хранения состояния оповещений серии, пропавшей из реестра
     } config;
 
 private:
-    boost::thread thread_; /// Метрики будут работать в отдельном потоке, чтобы не
-                           /// терять данные при возможном зависании плагинов.
-    std::set<Metrics::Uploader *> uploaders_;
-    std::set<Metrics::Metric *> metrics_;
-    std::mutex statistics_mutex_;
+    std::vector<boost::thread> threads_; /// Метрики будут работать в отдельных потоках, чтобы не
+                                         /// терять данные при возможном зависании плагинов.
+    std::mutex statistics_mutex_; /// Защищает uploaders_, но не реестр метрик
+#if METRICS_SELF_INSTRUMENTATION
+    using StatisticsLock = Metrics::TimedLock;
+#else
+    using StatisticsLock = std::lock_guard<std::mutex>;
+#endif
+    StatisticsLock lockStatistics(); /// statistics_mutex_, с самоинструментированием — с замером ожидания
+    std::mutex providers_mutex_;  /// Защищает провайдеров оповещений, удерживается на время работы NotifyManager
+    std::map<NotifierSystem::NotifierProvider *, std::shared_ptr<NotifierSystem::AlertQueue>> alert_queues_;
+
+    Metrics::Registry registry_;
+    Metrics::KeyTable keys_; /// Ключи серий всех метрик, общие для всех плагинов
+    Metrics::History history_;
+    Metrics::ValueStore values_;
+    Metrics::ImportTable imports_;
+    /// Сливает шарды метрик и с with_history дописывает такт в историю; без нее — для расписаний
+    /// загрузчиков и групп правил, такт истории остается тактом модели
+    void collect(bool with_history = true);
+    void collectStore(bool with_history); /// collect() с включенным ValueStore, под Registry::Walk
+    /// Сбор для расписаний загрузчиков: только метрики с шардами, Histogram и StaticCounter. Слоты
+    /// перестраиваются при изменении реестра; с ValueStore — collect(false), он и так обходит только их
+    void collectMerged();
+    std::vector<uint32_t> merge_slots_; /// Под statistics_mutex_
+    uint64_t merge_version_ = UINT64_MAX;
+    void publishSeriesStats(); /// Количество серий, память и имена с наибольшим числом серий в self-метрики
+
+    /// Снимок прошлого запуска: Counter продолжают счет с сохраненного значения
+    void loadPersisted();
+    void restore(Metrics::Metric &metric); /// Из Metric::attach до публикации и для метрик, созданных раньше загрузки
+    void persist(const Metrics::Snapshot &snapshot); /// Из strand NotifyManager, обходит реестр сам
+    std::unique_ptr<Metrics::SnapshotFile> restored_file_;
+    std::atomic<const Metrics::SnapshotFile *> restored_ = nullptr;
+    size_t persist_ticks_ = 0;
+
+    /// Серии "<name> __overflow__=true" для метрик сверх бюджета серий, по одной на имя
+    Metrics::Metric *overflowSeries(const std::string &name);
+    std::mutex overflow_mutex_;
+    std::map<std::string, std::unique_ptr<Metrics::Metric>> overflow_series_;
+    uint64_t static_version_ = UINT64_MAX; /// Версия списка StaticCounter, для которой созданы Metric
+
+    std::shared_ptr<const Metrics::Snapshot> takeSnapshot(bool track_changes);
+    /// Изменения значений по series_id для загрузчиков с changes_only, только из потока такта
+    uint32_t snapshot_tick_ = 0;
+    std::vector<size_t> last_values_;
+    std::vector<uint32_t> changed_tick_; /// 0 — серия еще не попадала в снимок
+
+    /// Собственные метрики модели. Значения обнуляются перед удалением, это не "зависшие" Gauge
+    struct SelfMetrics {
+        std::unique_ptr<Metrics::Gauge> snapshot_lock_us; /// Время обхода реестра при снимке
+        std::unique_ptr<Metrics::Counter> notify_dropped; /// Такты, пропущенные пока NotifyManager был занят
+        std::unique_ptr<Metrics::Gauge> series_count;     /// Интернированные серии
+        std::unique_ptr<Metrics::Gauge> series_key_bytes; /// Память под ключи серий
+        std::unique_ptr<Metrics::Gauge> history_bytes;
+        std::unique_ptr<Metrics::Gauge> registry_bytes;
+        std::unique_ptr<Metrics::Counter> series_overflow; /// Метрики, сведенные в серию __overflow__
+        std::unique_ptr<Metrics::Gauge> persist_us;        /// Время последней записи persistFile
+        std::unique_ptr<Metrics::Gauge> import_series;     /// Серии в таблице importBatch
+        std::unique_ptr<Metrics::Counter> import_expired;  /// Серии importBatch, удаленные по importTtl
+        std::unique_ptr<Metrics::Counter> import_dropped;  /// Значения importBatch с неизвестным id
+        std::unique_ptr<Metrics::MetricFamily<Metrics::Gauge>> series_per_name; /// Только topSeriesNames имен
+        std::set<std::string> published_names;
+        ~SelfMetrics();
+    } self_metrics_;
+    /// Создается в init: загрузчики и провайдеры, зарегистрированные до postInit, тоже получают гистограммы
+    METRICS_INSTRUMENT(std::unique_ptr<Metrics::Instrumentation> instruments_;)
 
     boost::asio::io_context io_;
     boost::asio::executor_work_guard<boost::asio::io_context::executor_type> io_guard =
         boost::asio::make_work_guard(io_);
+    /// Закрытые очереди снятых провайдеров, на которые еще ссылаются обработчики их strand, под providers_mutex_.
+    /// Удаляются вне io-потоков: при следующей регистрации или снятии провайдера и вместе с моделью
+    std::vector<std::shared_ptr<NotifierSystem::AlertQueue>> retired_queues_;
+    /// Очереди retired_queues_ без обработчиков, под providers_mutex_; в io-потоке — ни одной
+    std::vector<std::shared_ptr<NotifierSystem::AlertQueue>> takeFinishedQueues();
+    using Strand = boost::asio::strand<boost::asio::io_context::executor_type>;
+
+    /// Загрузчик выполняется в своем strand и не может занять больше uploaderInFlight тактов сразу,
+    /// лишние такты отбрасываются: следующий такт все равно принесет более свежие значения.
+    struct UploaderState {
+        UploaderState(Metrics::Uploader *uploader, boost::asio::io_context &io);
+        ~UploaderState();
+        Strand strand;
+        std::atomic<size_t> in_flight = 0;
+        std::unique_ptr<Metrics::Gauge> upload_us; /// Время последней выгрузки
+        std::unique_ptr<Metrics::Gauge> lag_us;    /// Задержка начала выгрузки от такта
+        std::unique_ptr<Metrics::Counter> dropped; /// Пропущенные такты
+        std::unique_ptr<Metrics::Gauge> samples;   /// Серий в последней выгрузке снимка
+        METRICS_INSTRUMENT(Metrics::Histogram *call_us = nullptr;) /// Время вызова загрузчика, в Instrumentation
+        /// Для changes_only, только из strand
+        uint32_t cursor      = 0; /// Такт последней успешной выгрузки
+        uint32_t resync_tick = 0; /// Такт последней успешной полной выгрузки
+        bool synced          = false;
+    };
+    std::map<Metrics::Uploader *, std::shared_ptr<UploaderState>> uploaders_;
+    /// Выгрузка для Uploader::changes_only, в strand загрузчика
+    static void uploadChanges(Metrics::Uploader &uploader, UploaderState &state, const Metrics::Snapshot &snapshot);
+
+    /// Передает снимок такта загрузчику в его strand. Обход реестра не переживает post: метрику, удаляемую
+    /// в io-потоке, не ждет обход такта, стоящего в очереди за ней
+    void dispatchUpload(Metrics::Uploader *uploader, const std::shared_ptr<UploaderState> &state,
+                        std::shared_ptr<const Metrics::Snapshot> snapshot, std::chrono::steady_clock::time_point tick_time,
+                        const Metrics::Scheduler::Pending &pending);
+    /// Свое расписание
+    bool uploaderTick(Metrics::Uploader *uploader, const std::weak_ptr<UploaderState> &weak,
+                      const Metrics::Scheduler::Pending &pending);
+    /// Проверка группы правил в strand NotifyManager под своим Registry::Walk; false — предыдущая проверка группы
+    /// еще не закончилась. Обработчик держит pending такта: время проверки входит в стоимость такта
+    bool postNotify(size_t group, std::shared_ptr<const Metrics::Snapshot> snapshot, bool persist,
+                    const Metrics::Scheduler::Pending &pending);
+
+    Strand notifier_strand_ = boost::asio::make_strand(io_);
+    std::unique_ptr<std::atomic<bool>[]> notifier_busy_; /// По группам правил NotifyManager
+    /// Расписание группы правил со своим интервалом
+    bool notifyTick(size_t group, const Metrics::Scheduler::Pending &pending);
 
     std::atomic<bool> stopToken = false;
 
-    boost::asio::steady_timer upload_timer_ = boost::asio::steady_timer(io_);
+    Metrics::Scheduler scheduler_ = Metrics::Scheduler(io_); /// Такт модели, загрузчики и группы правил
+    Metrics::Scheduler::Options scheduleOptions(std::chrono::milliseconds interval) const;
     void run();
-    void timer_handler(const boost::system::error_code &ec);
+    bool timer_handler(std::chrono::milliseconds period, const Metrics::Scheduler::Pending &pending = {}); /// Такт модели
+    std::chrono::milliseconds history_period_{0};         /// Период, по которому History считает rate()
 
     NotifierSystem::NotifyManager notifier_manager = {&config};
-};
+};
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "MetricsRegistry.hpp"
+#include <stdexcept>
+#include <thread>
+
+namespace Metrics
+{
+
+    Registry::~Registry()
+    {
+        for (auto &chunk : chunks_) delete[] chunk.load();
+    }
+
+    Registry::Slot &Registry::slot(uint32_t index)
+    {
+        auto &chunk = chunks_[index / chunk_size];
+        auto slots  = chunk.load(std::memory_order_acquire);
+        if (!slots) {
+            auto fresh = new Slot[chunk_size];
+            if (chunk.compare_exchange_strong(slots, fresh, std::memory_order_acq_rel))
+                slots = fresh;
+            else
+                delete[] fresh; // Чанк уже создал другой поток
+        }
+        return slots[index % chunk_size];
+    }
+
+    size_t Registry::enter() const
+    {
+        for (;;) {
+            auto epoch = epoch_.load();
+            walkers_[epoch & 1].fetch_add(1);
+            // Если эпоха уже сменилась, удаление могло не увидеть этот обход: учитываемся в новой
+            if (epoch_.load() == epoch) return epoch;
+            walkers_[epoch & 1].fetch_sub(1);
+        }
+    }
+
+    void Registry::synchronize(size_t epoch)
+    {
+        std::lock_guard<std::mutex> lock(epoch_mutex_);
+        // Эпоха меняется только здесь, после ожидания ее обходов: если она уже ушла дальше epoch,
+        // обходы epoch и более ранних закончились, новые же начаты после очистки слота
+        if (epoch_.load() != epoch) return;
+        epoch_.store(epoch + 1);
+        while (walkers_[epoch & 1].load()) std::this_thread::yield();
+    }
+
+    uint32_t Registry::add(Metric *metric)
+    {
+        auto index = reserve();
+        publish(index, metric);
+        return index;
+    }
+
+    uint32_t Registry::reserve()
+    {
+        uint32_t index = no_slot;
+        auto head      = free_head_.load(std::memory_order_acquire);
+        while (uint32_t(head) != no_slot) {
+            auto next = slot(uint32_t(head)).next_free.load(std::memory_order_relaxed);
+            auto tag  = (head >> 32) + 1;
+            if (free_head_.compare_exchange_weak(head, (tag << 32) | next, std::memory_order_acq_rel)) {
+                index = uint32_t(head);
+                break;
+            }
+        }
+        if (index == no_slot) {
+            index = top_.fetch_add(1, std::memory_order_acq_rel);
+            if (index >= chunk_size * max_chunks) throw std::length_error("Metrics::Registry is full");
+        }
+        slot(index);
+        return index;
+    }
+
+    void Registry::publish(uint32_t index, Metric *metric)
+    {
+        slot(index).metric.store(metric);
+        size_.fetch_add(1, std::memory_order_relaxed);
+        version_.fetch_add(1);
+    }
+
+    void Registry::remove(uint32_t index)
+    {
+        auto &s = slot(index);
+        s.metric.store(nullptr);
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        version_.fetch_add(1);
+        // Обходчик мог взять указатель до очистки слота, ждем обходы, начатые до нее
+        synchronize(epoch_.load());
+        auto head = free_head_.load(std::memory_order_acquire);
+        do {
+            s.next_free.store(uint32_t(head), std::memory_order_relaxed);
+        } while (!free_head_.compare_exchange_weak(head, (((head >> 32) + 1) << 32) | index, std::memory_order_acq_rel));
+    }
+
+} // namespace Metrics
@@ -0,0 +1,95 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace Metrics
+{
+    class Metric;
+
+    /// Реестр метрик: таблица слотов с регистрацией без блокировок.
+    /// Регистрация занимает свободный слот за O(1) и никогда не ждет обход реестра.
+    /// Снятие с регистрации ждет только обходы, начатые до очистки слота, чтобы обходчик не прочитал
+    /// удаленную метрику: обходы считаются по двум эпохам, и удаление переключает эпоху и ждет старую.
+    class Registry
+    {
+    public:
+        static constexpr uint32_t chunk_size = 4096;
+        static constexpr uint32_t max_chunks = 4096;
+        static constexpr uint32_t no_slot    = UINT32_MAX;
+
+        Registry() = default;
+        ~Registry();
+        Registry(const Registry &)            = delete;
+        Registry &operator=(const Registry &) = delete;
+
+        uint32_t add(Metric *metric);
+        void remove(uint32_t slot);
+        /// add() в два шага: слот, который обходчики еще не видят, и его публикация
+        uint32_t reserve();
+        void publish(uint32_t slot, Metric *metric);
+
+        /// Пока жив Walk, ни одна метрика из реестра не будет уничтожена
+        class Walk
+        {
+            const Registry &registry_;
+            size_t epoch_;
+
+        public:
+            explicit Walk(const Registry &registry) : registry_(registry), epoch_(registry.enter()) {}
+            Walk(const Walk &)            = delete;
+            Walk &operator=(const Walk &) = delete;
+            ~Walk() { registry_.walkers_[epoch_ & 1].fetch_sub(1); }
+        };
+
+        /// Вызывать только под Walk
+        template <class F> void forEach(F &&f) const
+        {
+            uint32_t top = this->top();
+            for (uint32_t chunk = 0; chunk * chunk_size < top; chunk++) {
+                auto slots = chunks_[chunk].load(std::memory_order_acquire);
+                if (!slots) continue;
+                for (uint32_t i = 0; i < chunk_size && chunk * chunk_size + i < top; i++)
+                    if (auto metric = slots[i].metric.load()) f(metric);
+            }
+        }
+
+        /// Метрика в слоте или nullptr, вызывать только под Walk
+        Metric *at(uint32_t index) const
+        {
+            auto slots = chunks_[index / chunk_size].load(std::memory_order_acquire);
+            return slots ? slots[index % chunk_size].metric.load() : nullptr;
+        }
+        uint32_t top() const { return std::min(top_.load(std::memory_order_acquire), chunk_size * max_chunks); }
+
+        size_t size() const { return size_.load(std::memory_order_relaxed); }
+        uint64_t version() const { return version_.load(); } /// Меняется при каждой регистрации и удалении
+        /// Память под слоты и таблицу блоков
+        size_t bytes() const
+        {
+            return (top() + chunk_size - 1) / chunk_size * chunk_size * sizeof(Slot) + sizeof(chunks_);
+        }
+
+    private:
+        struct Slot {
+            std::atomic<Metric *> metric    = nullptr;
+            std::atomic<uint32_t> next_free = no_slot;
+        };
+
+        Slot &slot(uint32_t index);
+        size_t enter() const; /// Учитывает обход в текущей эпохе и возвращает ее
+        void synchronize(size_t epoch); /// Ждет конца обходов эпохи epoch и более ранних
+
+        std::atomic<Slot *> chunks_[max_chunks] = {};
+        std::atomic<uint32_t> top_              = 0;       /// Слоты, выданные хотя бы раз
+        std::atomic<uint64_t> free_head_        = no_slot; /// {тег ABA, индекс} стека свободных слотов
+        std::atomic<size_t> size_               = 0;
+        std::atomic<uint64_t> version_          = 0;
+        std::atomic<size_t> epoch_              = 0;
+        mutable std::atomic<size_t> walkers_[2] = {}; /// Идущие обходы по четности эпохи
+        std::mutex epoch_mutex_;                      /// Переключение эпохи и ожидание ее обходов
+    };
+
+} // namespace Metrics
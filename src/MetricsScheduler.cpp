@@ -0,0 +1,115 @@
+#include "MetricsScheduler.hpp"
+#include <PluginCore/Logger/Log>
+#include <algorithm>
+
+#define LOG_NAME "MetricsScheduler"
+
+namespace Metrics
+{
+
+    Scheduler::Stats::Stats(const std::string &name)
+    {
+        std::vector<Tag> tags = {{"schedule", name}};
+        jitter_us = std::make_unique<Gauge>("MetricsModel_schedule_jitter_us", tags, Mode::Sharded);
+        cost_us   = std::make_unique<Gauge>("MetricsModel_schedule_cost_us", tags, Mode::Sharded);
+        period_ms = std::make_unique<Gauge>("MetricsModel_schedule_period_ms", tags, Mode::Sharded);
+        overrun   = std::make_unique<Counter>("MetricsModel_schedule_overrun", tags, Mode::Sharded);
+    }
+
+    Scheduler::Stats::~Stats()
+    {
+        *jitter_us = 0;
+        *cost_us   = 0;
+        *period_ms = 0;
+    }
+
+    Scheduler::Schedule::Schedule(boost::asio::io_context &io, const std::string &name_, Options options_,
+                                  Callback callback_)
+        : name(name_), options(options_), callback(std::move(callback_)), timer(io),
+          stats(std::make_unique<Stats>(name_))
+    {
+        options.interval     = std::max(options.interval, std::chrono::milliseconds(1));
+        options.max_slowdown = std::max<size_t>(options.max_slowdown, 1);
+        *stats->period_ms    = options.interval.count();
+    }
+
+    void Scheduler::add(const std::string &name, Options options, Callback callback)
+    {
+        auto schedule      = std::make_shared<Schedule>(io_, name, options, std::move(callback));
+        schedule->deadline = Clock::now() + schedule->period();
+        std::vector<std::unique_ptr<Stats>> retired;
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired.swap(retired_); // Удаляются после снятия блокировки, в потоке вызывающего
+        if (stopped_) return;
+        schedules_.push_back(schedule);
+        arm(schedule);
+    }
+
+    void Scheduler::stop()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+        for (auto &schedule : schedules_) schedule->timer.cancel();
+    }
+
+    void Scheduler::arm(const std::shared_ptr<Schedule> &schedule)
+    {
+        schedule->timer.expires_at(schedule->deadline);
+        schedule->timer.async_wait([this, schedule](const boost::system::error_code &ec) {
+            if (ec && ec != boost::asio::error::operation_aborted) R_LOG(1, schedule->name << ": " << ec.message());
+            if (!ec) fire(schedule);
+        });
+    }
+
+    void Scheduler::fire(const std::shared_ptr<Schedule> &schedule)
+    {
+        auto start  = Clock::now();
+        auto &stats = *schedule->stats;
+        *stats.jitter_us =
+            std::chrono::duration_cast<std::chrono::microseconds>(std::max(start - schedule->deadline, Clock::duration{}))
+                .count();
+        // Работа прошлого такта еще идет: он стоит не меньше, чем прошло от его начала
+        Clock::duration tail{};
+        if (!schedule->last.expired()) tail = start - schedule->last_start;
+        Pending pending(nullptr, [cost = schedule->tail, start](void *) { *cost = (Clock::now() - start).count(); });
+        bool keep = false;
+        try {
+            keep = schedule->callback(std::chrono::duration_cast<std::chrono::milliseconds>(schedule->period()),
+                                      pending);
+        } catch (std::exception &e) {
+            R_LOG(1, "Exception throwed in schedule " << schedule->name << ": " << e.what());
+            keep = true;
+        }
+        schedule->last       = pending;
+        schedule->last_start = start;
+        pending.reset(); // Без отправленной работы такт закончен здесь
+        auto end = Clock::now();
+        // Этот такт до возврата обработчика или последний такт, работа которого завершилась
+        auto cost = std::max({end - start, tail, Clock::duration(schedule->tail->exchange(0))});
+        *stats.cost_us = std::chrono::duration_cast<std::chrono::microseconds>(cost).count();
+
+        auto &options = schedule->options;
+        if (options.budget_percent) {
+            auto budget = schedule->period() * options.budget_percent / 100;
+            if (cost > budget && schedule->slowdown < options.max_slowdown)
+                schedule->slowdown = std::min(schedule->slowdown * 2, options.max_slowdown);
+            else if (cost * 2 < budget && schedule->slowdown > 1)
+                schedule->slowdown /= 2;
+            *stats.period_ms = std::chrono::duration_cast<std::chrono::milliseconds>(schedule->period()).count();
+        }
+        // Срок от прошлого срока: время обработчика не сдвигает сетку тактов
+        auto period = schedule->period();
+        schedule->deadline += period;
+        if (schedule->deadline <= end) {
+            auto missed = (end - schedule->deadline) / period + 1;
+            *stats.overrun += missed;
+            schedule->deadline += period * missed;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (keep && !stopped_) return arm(schedule);
+        std::erase(schedules_, schedule);
+        retired_.push_back(std::move(schedule->stats));
+    }
+
+} // namespace Metrics
@@ -0,0 +1,85 @@
+#pragma once
+#include "Metrics.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Metrics
+{
+
+    /// Именованные расписания MetricsModel на общем io_context. Срок следующего такта считается от срока
+    /// предыдущего, а не от конца обработчика, поэтому период не уплывает на время работы такта. Такты, срок
+    /// которых прошел, пока выполнялся обработчик, пропускаются и считаются в overrun. С budget_percent
+    /// период удваивается (до max_slowdown раз), когда такт дольше этой доли периода, и возвращается,
+    /// когда такт вдвое короче. Стоимость такта — до завершения отправленной им работы (Pending): обработчик,
+    /// который только раздает выгрузки по strand, дешев, а работа за ним — нет. Обработчики одного расписания
+    /// не пересекаются, разных — могут. Self-метрики с тегом schedule=name: MetricsModel_schedule_jitter_us
+    /// (опоздание начала такта), MetricsModel_schedule_cost_us, MetricsModel_schedule_period_ms и
+    /// MetricsModel_schedule_overrun.
+    /// Метрики законченного расписания удаляются в следующем add() или в деструкторе, а не в потоке io:
+    /// удаление метрики ждет Registry::Walk, который отпустит только обработчик из очереди того же io.
+    class Scheduler
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Options {
+            std::chrono::milliseconds interval{1000};
+            size_t budget_percent = 0; /// 0 — без замедления
+            size_t max_slowdown   = 8;
+        };
+        /// Работа такта, отправленная в другие strand, держит копию: такт закончен, когда удалена последняя
+        using Pending = std::shared_ptr<void>;
+        /// Вызывается в потоке io с текущим периодом; false — расписание удаляется
+        using Callback = std::function<bool(std::chrono::milliseconds period, const Pending &pending)>;
+
+        explicit Scheduler(boost::asio::io_context &io) : io_(io) {}
+        ~Scheduler() { stop(); }
+
+        /// Первый такт через один период
+        void add(const std::string &name, Options options, Callback callback);
+        /// Отменяет таймеры, новые такты не начинаются; выполняющийся обработчик не прерывается
+        void stop();
+
+    private:
+        struct Stats {
+            explicit Stats(const std::string &name);
+            ~Stats();
+            std::unique_ptr<Gauge> jitter_us;
+            std::unique_ptr<Gauge> cost_us;
+            std::unique_ptr<Gauge> period_ms;
+            std::unique_ptr<Counter> overrun; /// Пропущенные такты
+        };
+        struct Schedule {
+            Schedule(boost::asio::io_context &io, const std::string &name, Options options, Callback callback);
+            std::string name;
+            Options options;
+            Callback callback;
+            boost::asio::steady_timer timer;
+            Clock::time_point deadline;
+            size_t slowdown = 1;
+            std::unique_ptr<Stats> stats;
+            /// Стоимость последнего такта, чья отправленная работа завершилась; пишет удаление Pending
+            std::shared_ptr<std::atomic<Clock::rep>> tail = std::make_shared<std::atomic<Clock::rep>>(0);
+            std::weak_ptr<void> last; /// Pending прошлого такта, только из fire
+            Clock::time_point last_start;
+            Clock::duration period() const { return options.interval * slowdown; }
+        };
+
+        void arm(const std::shared_ptr<Schedule> &schedule); /// Под mutex_
+        void fire(const std::shared_ptr<Schedule> &schedule);
+
+        boost::asio::io_context &io_;
+        std::mutex mutex_; /// Защищает schedules_, stopped_ и таймеры расписаний
+        std::vector<std::shared_ptr<Schedule>> schedules_;
+        std::vector<std::unique_ptr<Stats>> retired_; /// Метрики законченных расписаний, под mutex_
+        bool stopped_ = false;
+    };
+
+} // namespace Metrics
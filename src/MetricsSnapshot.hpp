@@ -0,0 +1,30 @@
+#pragma once
+#include "SeriesKeys.hpp"
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace Metrics
+{
+
+    struct Sample {
+        uint32_t id;           /// Metric::series_id, индекс в KeyTable
+        bool imported = false; /// Metric::imported, занимает выравнивание и не увеличивает Sample
+        size_t value;
+    };
+
+    /// Неизменяемый снимок значений всех метрик на момент сбора
+    struct Snapshot {
+        std::vector<Sample> samples;
+        const KeyTable *keys = nullptr;
+        std::chrono::system_clock::time_point time;
+        uint32_t tick = 0;   /// Номер снимка, растет на 1 с каждым тактом
+        bool full     = true; /// false — только серии, изменившиеся после прошлой успешной выгрузки загрузчика
+        /// Такт последнего изменения значения, параллельно samples. Заполняется, только если есть
+        /// загрузчики с changes_only, в снимок с full == false не копируется
+        std::vector<uint32_t> changed;
+
+        const SeriesKey &key(const Sample &sample) const { return (*keys)[sample.id]; }
+    };
+
+} // namespace Metrics
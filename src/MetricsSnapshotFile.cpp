@@ -0,0 +1,220 @@
+#include "MetricsSnapshotFile.hpp"
+#include <algorithm>
+#include <boost/crc.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+namespace Metrics
+{
+
+    namespace
+    {
+        constexpr char magic[8]       = {'M', 'E', 'T', 'R', 'S', 'N', 'A', 'P'};
+        constexpr uint32_t byte_order = 0x01020304; /// Файл читается только на машине с тем же порядком байт
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t byte_order;
+            uint64_t series;
+            uint64_t alerts;
+            uint64_t strings;
+            int64_t time;
+            uint32_t crc; /// CRC-32 всего, что после заголовка
+            uint32_t reserved;
+        };
+        static_assert(sizeof(Header) % 8 == 0 && sizeof(SnapshotFile::Series) % 8 == 0 &&
+                      sizeof(SnapshotFile::Alert) % 8 == 0);
+
+        [[noreturn]] void fail(const std::string &path, const std::string &what)
+        {
+            throw std::runtime_error("snapshot file " + path + ": " + what);
+        }
+
+        uint32_t crc(const char *data, size_t size)
+        {
+            boost::crc_32_type crc;
+            crc.process_bytes(data, size);
+            return crc.checksum();
+        }
+
+        bool alertLess(const SnapshotFile::Alert &a, const SnapshotFile::Alert &b)
+        {
+            return std::tie(a.series_hash, a.rule_hash) < std::tie(b.series_hash, b.rule_hash);
+        }
+    }
+
+    SnapshotFile::~SnapshotFile()
+    {
+        if (data_) munmap(data_, bytes_);
+    }
+
+    void SnapshotFile::write(const std::string &path, const Snapshot &snapshot, std::span<Alert> alerts)
+    {
+        // Серии по хэшу ключа, метрики с одним ключом складываются в одну запись
+        std::vector<std::pair<uint64_t, uint32_t>> order; // (хэш, номер образца)
+        order.reserve(snapshot.samples.size());
+        for (uint32_t i = 0; i < snapshot.samples.size(); i++)
+            if (!snapshot.samples[i].imported) order.emplace_back(snapshot.key(snapshot.samples[i]).hash, i);
+        std::sort(order.begin(), order.end(), [&](auto &a, auto &b) {
+            return std::tie(a.first, snapshot.samples[a.second].id) < std::tie(b.first, snapshot.samples[b.second].id);
+        });
+        std::vector<Series> series;
+        std::vector<uint32_t> ids; // series_id записи, для поиска записей оповещений
+        uint64_t strings = 0;
+        for (auto [hash, index] : order) {
+            auto &sample = snapshot.samples[index];
+            if (!ids.empty() && ids.back() == sample.id) {
+                series.back().value += sample.value;
+                continue;
+            }
+            auto key = snapshot.key(sample).key;
+            series.push_back({hash, sample.value, uint32_t(strings), uint32_t(key.size())});
+            ids.push_back(sample.id);
+            strings += key.size();
+        }
+        std::vector<Alert> records;
+        for (auto alert : alerts) {
+            auto i = std::lower_bound(series.begin(), series.end(), alert.series_hash,
+                                      [](const Series &s, uint64_t hash) { return s.hash < hash; });
+            while (i != series.end() && i->hash == alert.series_hash && ids[i - series.begin()] != alert.series) i++;
+            if (i == series.end() || i->hash != alert.series_hash) continue;
+            alert.series = i - series.begin();
+            records.push_back(alert);
+        }
+        std::sort(records.begin(), records.end(), alertLess);
+
+        size_t body = series.size() * sizeof(Series) + records.size() * sizeof(Alert) + strings;
+        std::vector<char> data(sizeof(Header) + body);
+        char *out = data.data() + sizeof(Header);
+        std::memcpy(out, series.data(), series.size() * sizeof(Series));
+        out += series.size() * sizeof(Series);
+        std::memcpy(out, records.data(), records.size() * sizeof(Alert));
+        out += records.size() * sizeof(Alert);
+        for (size_t i = 0; i < series.size(); i++) {
+            auto key = (*snapshot.keys)[ids[i]].key;
+            std::memcpy(out + series[i].key_offset, key.data(), key.size());
+        }
+        Header header = {};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version    = version;
+        header.byte_order = byte_order;
+        header.series     = series.size();
+        header.alerts     = records.size();
+        header.strings    = strings;
+        header.time       = std::chrono::duration_cast<std::chrono::seconds>(snapshot.time.time_since_epoch()).count();
+        header.crc        = crc(data.data() + sizeof(Header), body);
+        std::memcpy(data.data(), &header, sizeof(Header));
+
+        // write(), а не запись через MAP_SHARED в файл после ftruncate: место под такой файл не выделено,
+        // и нехватка его на диске пришла бы сигналом SIGBUS, а не ошибкой
+        auto tmp = path + ".tmp";
+        int fd   = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) fail(tmp, strerror(errno));
+        auto failWrite = [&](int error) {
+            ::close(fd);
+            unlink(tmp.c_str());
+            fail(tmp, strerror(error));
+        };
+        for (size_t done = 0; done < data.size();) {
+            auto written = ::write(fd, data.data() + done, data.size() - done);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) failWrite(written < 0 ? errno : EIO);
+            done += written;
+        }
+        if (fsync(fd) != 0) failWrite(errno);
+        ::close(fd);
+        if (rename(tmp.c_str(), path.c_str()) != 0) {
+            int error = errno;
+            unlink(tmp.c_str());
+            fail(path, strerror(error));
+        }
+        // Переименование переживет сбой питания только после fsync каталога
+        auto dir   = std::filesystem::path(path).parent_path();
+        int dir_fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dir_fd < 0) fail(dir.string(), strerror(errno));
+        bool synced = fsync(dir_fd) == 0;
+        int error   = errno;
+        ::close(dir_fd);
+        if (!synced) fail(dir.string(), strerror(error));
+    }
+
+    void SnapshotFile::open(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) fail(path, strerror(errno));
+        struct stat st = {};
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+            ::close(fd);
+            fail(path, "too short");
+        }
+        bytes_ = st.st_size;
+        data_  = mmap(nullptr, bytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data_ == MAP_FAILED) {
+            data_ = nullptr;
+            fail(path, strerror(errno));
+        }
+        auto data = static_cast<const char *>(data_);
+        Header header;
+        std::memcpy(&header, data, sizeof(Header));
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.byte_order != byte_order)
+            fail(path, "not a metrics snapshot");
+        if (header.version != version) fail(path, "unsupported version " + std::to_string(header.version));
+        size_t body = header.series * sizeof(Series) + header.alerts * sizeof(Alert) + header.strings;
+        if (header.series > bytes_ || header.alerts > bytes_ || header.strings > bytes_ ||
+            sizeof(Header) + body != bytes_)
+            fail(path, "size mismatch");
+        if (crc(data + sizeof(Header), body) != header.crc) fail(path, "checksum mismatch");
+
+        series_       = reinterpret_cast<const Series *>(data + sizeof(Header));
+        alerts_       = reinterpret_cast<const Alert *>(series_ + header.series);
+        strings_      = reinterpret_cast<const char *>(alerts_ + header.alerts);
+        series_count_ = header.series;
+        alerts_count_ = header.alerts;
+        time_         = header.time;
+        for (size_t i = 0; i < series_count_; i++)
+            if (size_t(series_[i].key_offset) + series_[i].key_size > header.strings) fail(path, "bad key offset");
+        claimed_       = std::make_unique<std::atomic<bool>[]>(series_count_);
+        alert_claimed_ = std::make_unique<std::atomic<bool>[]>(alerts_count_);
+    }
+
+    const SnapshotFile::Series *SnapshotFile::find(const SeriesKey &key) const
+    {
+        auto end = series_ + series_count_;
+        for (auto it = std::lower_bound(series_, end, key.hash,
+                                        [](const Series &s, uint64_t hash) { return s.hash < hash; });
+             it != end && it->hash == key.hash; it++)
+            if (std::string_view(strings_ + it->key_offset, it->key_size) == key.key) return it;
+        return nullptr;
+    }
+
+    std::optional<size_t> SnapshotFile::claim(const SeriesKey &key) const
+    {
+        auto series = find(key);
+        if (!series || claimed_[series - series_].exchange(true)) return std::nullopt;
+        return series->value;
+    }
+
+    const SnapshotFile::Alert *SnapshotFile::claimAlert(const SeriesKey &key, uint64_t rule_hash) const
+    {
+        auto series = find(key);
+        if (!series) return nullptr;
+        Alert probe = {key.hash, rule_hash, 0, 0, 0, 0, 0};
+        auto end    = alerts_ + alerts_count_;
+        for (auto it = std::lower_bound(alerts_, end, probe, alertLess);
+             it != end && it->series_hash == key.hash && it->rule_hash == rule_hash; it++)
+            if (it->series == uint32_t(series - series_)) return alert_claimed_[it - alerts_].exchange(true) ? nullptr : it;
+        return nullptr;
+    }
+
+} // namespace Metrics
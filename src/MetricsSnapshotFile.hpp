@@ -0,0 +1,76 @@
+#pragma once
+#include "MetricsSnapshot.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace Metrics
+{
+
+    /// Двоичный снимок значений серий и состояния оповещений для восстановления после перезапуска.
+    /// Файл: заголовок с версией и CRC-32, массив серий, отсортированный по хэшу ключа, массив состояний
+    /// оповещений и строки ключей. Читается через mmap без разбора: поиск — двоичный поиск прямо по файлу.
+    /// Пишется во временный файл рядом и переименовывается, поэтому читатель никогда не видит файл наполовину.
+    class SnapshotFile
+    {
+    public:
+        static constexpr uint32_t version = 1;
+
+        struct Series {
+            uint64_t hash;
+            uint64_t value;
+            uint32_t key_offset; /// SeriesKey::key в области строк
+            uint32_t key_size;
+        };
+
+        /// Состояние пары (серия, правило) NotifyManager
+        struct Alert {
+            uint64_t series_hash;
+            uint64_t rule_hash;
+            uint64_t window;
+            uint64_t current;
+            uint64_t total;
+            uint32_t series; /// Номер в массиве серий, для сверки ключа
+            uint32_t firing;
+        };
+
+        SnapshotFile() = default;
+        ~SnapshotFile();
+        SnapshotFile(const SnapshotFile &)            = delete;
+        SnapshotFile &operator=(const SnapshotFile &) = delete;
+
+        /// Пишет серии снимка (imported пропускаются, метрики с одним ключом суммируются) и alerts, у которых
+        /// series — series_id, при записи он заменяется номером записи серии. Бросает std::runtime_error.
+        static void write(const std::string &path, const Snapshot &snapshot, std::span<Alert> alerts);
+
+        /// Отображает файл и проверяет заголовок и CRC, бросает std::runtime_error
+        void open(const std::string &path);
+
+        size_t size() const { return series_count_; }
+        int64_t time() const { return time_; } /// Время снимка, секунды Unix
+
+        /// Значение серии и состояние оповещения выдаются один раз: повторный вызов для того же ключа — пусто
+        std::optional<size_t> claim(const SeriesKey &key) const;
+        const Alert *claimAlert(const SeriesKey &key, uint64_t rule_hash) const;
+
+    private:
+        const Series *find(const SeriesKey &key) const;
+
+        void *data_           = nullptr;
+        size_t bytes_         = 0;
+        const Series *series_ = nullptr;
+        const Alert *alerts_  = nullptr;
+        const char *strings_  = nullptr;
+        size_t series_count_  = 0;
+        size_t alerts_count_  = 0;
+        int64_t time_         = 0;
+        std::unique_ptr<std::atomic<bool>[]> claimed_;
+        std::unique_ptr<std::atomic<bool>[]> alert_claimed_;
+    };
+
+} // namespace Metrics
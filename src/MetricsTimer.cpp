@@ -0,0 +1,34 @@
+#include "MetricsTimer.hpp"
+#include <thread>
+
+namespace Metrics
+{
+
+    const char *TimerClock::name() noexcept
+    {
+#if METRICS_TIMER_CLOCK == METRICS_CLOCK_TSC
+        return "tsc";
+#elif METRICS_TIMER_CLOCK == METRICS_CLOCK_COARSE
+        return "monotonic_coarse";
+#else
+        return "steady";
+#endif
+    }
+
+#if METRICS_TIMER_CLOCK == METRICS_CLOCK_TSC
+    uint64_t TimerClock::tscScale() noexcept
+    {
+        // Частота TSC постоянна на современных x86 (constant_tsc), достаточно одного замера на 10 мс
+        static const uint64_t scale = [] {
+            auto start_time = std::chrono::steady_clock::now();
+            auto start_tsc  = __rdtsc();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            auto ns    = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time);
+            auto ticks = __rdtsc() - start_tsc;
+            return ticks ? (static_cast<unsigned __int128>(ns.count()) << 32) / ticks : uint64_t(1) << 32;
+        }();
+        return scale;
+    }
+#endif
+
+} // namespace Metrics
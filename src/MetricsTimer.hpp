@@ -0,0 +1,119 @@
+#pragma once
+#include "Metrics.hpp"
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/// Источник времени для ScopedTimer, выбирается при сборке: -DMETRICS_TIMER_CLOCK=METRICS_CLOCK_TSC
+#define METRICS_CLOCK_STEADY 0 /// std::chrono::steady_clock, ~20 нс, точный
+#define METRICS_CLOCK_COARSE 1 /// CLOCK_MONOTONIC_COARSE, несколько нс, шаг 1-4 мс (тик ядра)
+#define METRICS_CLOCK_TSC 2    /// rdtsc, калиброванный по steady_clock при первом использовании, только x86
+
+#ifndef METRICS_TIMER_CLOCK
+#define METRICS_TIMER_CLOCK METRICS_CLOCK_STEADY
+#endif
+
+#if METRICS_TIMER_CLOCK == METRICS_CLOCK_TSC && !defined(__x86_64__) && !defined(__i386__)
+#undef METRICS_TIMER_CLOCK
+#define METRICS_TIMER_CLOCK METRICS_CLOCK_STEADY
+#endif
+
+namespace Metrics
+{
+
+    /// Часы ScopedTimer: now() в собственных единицах, перевод в наносекунды только при записи
+    struct TimerClock {
+        static uint64_t now() noexcept
+        {
+#if METRICS_TIMER_CLOCK == METRICS_CLOCK_TSC
+            return __rdtsc();
+#elif METRICS_TIMER_CLOCK == METRICS_CLOCK_COARSE
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+            return uint64_t(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+#endif
+        }
+
+        static uint64_t toNanoseconds(uint64_t ticks) noexcept
+        {
+#if METRICS_TIMER_CLOCK == METRICS_CLOCK_TSC
+            return (static_cast<unsigned __int128>(ticks) * tscScale()) >> 32;
+#else
+            return ticks;
+#endif
+        }
+
+        static const char *name() noexcept;
+
+#if METRICS_TIMER_CLOCK == METRICS_CLOCK_TSC
+        /// Наносекунд на такт TSC в формате 32.32, измеряется один раз
+        static uint64_t tscScale() noexcept;
+#endif
+    };
+
+    /// Единица, в которой ScopedTimer записывает время
+    enum class TimeUnit : uint32_t { Nanoseconds = 1, Microseconds = 1'000, Milliseconds = 1'000'000 };
+
+    inline void recordElapsed(Histogram &target, size_t value) noexcept { target.record(value); }
+    inline void recordElapsed(Gauge &target, size_t value) { target = value; }
+    inline void recordElapsed(Counter &target, size_t value) { target += value; }
+
+    /// Записывает время жизни объекта в Histogram (распределение), Gauge (последнее) или Counter (суммарное).
+    /// sample_every = N: замеряется в среднем один вызов из N, остальные стоят несколько тактов.
+    /// С in_flight дополнительно ведет MetricGuard — количество выполняющихся операций.
+    template <class Target> class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(Target &target, TimeUnit unit = TimeUnit::Microseconds, uint32_t sample_every = 1)
+            : target_(target), unit_(static_cast<uint32_t>(unit))
+        {
+            if (sampled(sample_every)) start_ = TimerClock::now();
+        }
+
+        template <class InFlight>
+        ScopedTimer(Target &target, InFlight &in_flight, TimeUnit unit = TimeUnit::Microseconds,
+                    uint32_t sample_every = 1)
+            : ScopedTimer(target, unit, sample_every)
+        {
+            guard_.emplace(in_flight);
+        }
+
+        ScopedTimer(const ScopedTimer &)            = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+        ~ScopedTimer()
+        {
+            if (start_) recordElapsed(target_, TimerClock::toNanoseconds(TimerClock::now() - start_) / unit_);
+        }
+
+        /// Не записывать время, например при ошибке
+        void cancel() noexcept { start_ = 0; }
+
+    private:
+        /// Случайная выборка, а не каждый N-й вызов: счетчик на поток смещал бы выборку
+        /// между чередующимися горячими участками
+        static bool sampled(uint32_t every) noexcept
+        {
+            if (every <= 1) return true;
+            static thread_local uint32_t state = 2463534242u + threadIndex();
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return (uint64_t(state) * every) >> 32 == 0;
+        }
+
+        Target &target_;
+        uint32_t unit_;
+        uint64_t start_ = 0;
+        std::optional<MetricGuard> guard_;
+    };
+
+} // namespace Metrics
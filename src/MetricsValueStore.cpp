@@ -0,0 +1,61 @@
+#include "MetricsValueStore.hpp"
+#include "Metrics.hpp"
+
+namespace Metrics
+{
+
+    ValueStore::~ValueStore()
+    {
+        for (auto &chunk : chunks_) delete chunk.load();
+    }
+
+    ValueStore::Chunk &ValueStore::chunk(uint32_t slot)
+    {
+        auto &chunk = chunks_[slot / chunk_size];
+        auto block  = chunk.load(std::memory_order_acquire);
+        if (!block) {
+            auto fresh = new Chunk();
+            for (auto &id : fresh->ids) id.store(KeyTable::no_id, std::memory_order_relaxed);
+            if (chunk.compare_exchange_strong(block, fresh, std::memory_order_acq_rel)) {
+                block = fresh;
+                bytes_.fetch_add(sizeof(Chunk), std::memory_order_relaxed);
+            } else
+                delete fresh; // Блок уже создал другой поток
+        }
+        return *block;
+    }
+
+    std::atomic<size_t> *ValueStore::bind(uint32_t slot)
+    {
+        auto &cell = chunk(slot).values[slot % chunk_size];
+        cell.store(0, std::memory_order_relaxed);
+        return &cell;
+    }
+
+    void ValueStore::unbind(uint32_t slot)
+    {
+        if (auto block = chunks_[slot / chunk_size].load(std::memory_order_acquire))
+            block->ids[slot % chunk_size].store(KeyTable::no_id, std::memory_order_relaxed);
+    }
+
+    void ValueStore::refresh(const Registry &registry)
+    {
+        auto version = registry.version();
+        if (version == version_) return;
+        version_ = version;
+        top_     = registry.top();
+        collect_list_.clear();
+        for (uint32_t slot = 0; slot < top_; slot++) {
+            auto metric = registry.at(slot);
+            if (!metric && !chunks_[slot / chunk_size].load(std::memory_order_acquire)) continue;
+            auto &block = chunk(slot);
+            auto i      = slot % chunk_size;
+            block.ids[i].store(metric ? metric->series_id : KeyTable::no_id, std::memory_order_relaxed);
+            if (!metric) continue;
+            bool direct    = metric->cell_ == &block.values[i];
+            block.flags[i] = (metric->imported ? imported : 0) | (direct ? bound : 0);
+            if (!direct) collect_list_.push_back(slot);
+        }
+    }
+
+} // namespace Metrics
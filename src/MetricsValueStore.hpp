@@ -0,0 +1,81 @@
+#pragma once
+#include "MetricsRegistry.hpp"
+#include "SeriesKeys.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Metrics
+{
+
+    /// Значения метрик в непрерывных, выровненных на 64 байта блоках по слотам реестра (структура массивов).
+    /// Counter, Gauge и Bool без шардов пишут прямо в свою ячейку, поэтому сбор, история и снимок проходят
+    /// по массивам линейно, не обращаясь к объектам Metric. Метрики с собственным сбором (шарды, Histogram)
+    /// и созданные до включения хранилища перечислены в collect_list и копируются в ячейку при сборе.
+    class ValueStore
+    {
+    public:
+        static constexpr uint32_t chunk_size = Registry::chunk_size;
+        static constexpr uint8_t imported    = 1; /// Флаги слота
+        static constexpr uint8_t bound       = 2; /// Метрика пишет прямо в ячейку
+
+        ValueStore() = default;
+        ~ValueStore();
+        ValueStore(const ValueStore &)            = delete;
+        ValueStore &operator=(const ValueStore &) = delete;
+
+        void enable() { enabled_.store(true, std::memory_order_release); }
+        bool enabled() const { return enabled_.load(std::memory_order_acquire); }
+
+        /// Обнуленная ячейка слота, вызывается до Registry::publish
+        std::atomic<size_t> *bind(uint32_t slot);
+        /// До Registry::remove: слот больше не попадает в обходы хранилища. Слот, освобожденный в реестре,
+        /// уже может принадлежать новой метрике, и поздний unbind скрыл бы ее серию до следующего refresh
+        void unbind(uint32_t slot);
+
+        void set(uint32_t slot, size_t value) { cell(slot).store(value, std::memory_order_relaxed); }
+        size_t get(uint32_t slot) const { return cell(slot).load(std::memory_order_relaxed); }
+
+        /// Пересобирает ids, флаги и collect_list по реестру, только если его версия изменилась.
+        /// Вызывать под Registry::Walk из потока сбора.
+        void refresh(const Registry &registry);
+        const std::vector<uint32_t> &collectList() const { return collect_list_; }
+
+        /// f(series_id, flags, value) по всем занятым слотам подряд, из потока сбора
+        template <class F> void forEach(F &&f) const
+        {
+            for (uint32_t chunk = 0; chunk * chunk_size < top_; chunk++) {
+                auto block = chunks_[chunk].load(std::memory_order_acquire);
+                if (!block) continue;
+                uint32_t count = std::min(chunk_size, top_ - chunk * chunk_size);
+                for (uint32_t i = 0; i < count; i++) {
+                    auto id = block->ids[i].load(std::memory_order_relaxed);
+                    if (id != KeyTable::no_id) f(id, block->flags[i], block->values[i].load(std::memory_order_relaxed));
+                }
+            }
+        }
+
+        size_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+    private:
+        struct Chunk {
+            alignas(64) std::atomic<size_t> values[chunk_size];
+            alignas(64) std::atomic<uint32_t> ids[chunk_size];
+            alignas(64) uint8_t flags[chunk_size];
+        };
+        Chunk &chunk(uint32_t slot);
+        std::atomic<size_t> &cell(uint32_t slot) const
+        {
+            return chunks_[slot / chunk_size].load(std::memory_order_acquire)->values[slot % chunk_size];
+        }
+
+        std::atomic<Chunk *> chunks_[Registry::max_chunks] = {};
+        std::atomic<bool> enabled_                         = false;
+        std::atomic<size_t> bytes_                         = 0;
+        uint64_t version_                                  = UINT64_MAX;
+        uint32_t top_                                      = 0; /// Registry::top() при последнем refresh
+        std::vector<uint32_t> collect_list_;
+    };
+
+} // namespace Metrics
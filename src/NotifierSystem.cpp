@@ -1,13 +1,16 @@
 #include "NotifierSystem.hpp"
 #include "Metrics.hpp"
 #include <algorithm>
-#include <boost/algorithm/string/replace.hpp>
+#include <bit>
+#include <cmath>
+#include <shared_mutex>
+#include <cctype>
+#include <limits>
 #include <boost/property_tree/ptree.hpp>
 #include <PluginCore/Logger/Log>
 #include <chrono>
 #include <memory>
 #include <string>
-#include <iomanip>
 
 #define LOG_NAME "NotifierSystem"
 
@@ -15,177 +18,362 @@ using boost::property_tree::ptree;
 namespace NotifierSystem
 {
 
-    bool check_condition(Condition &c, size_t metric_value)
+    size_t Condition::evaluate(const Metrics::Metric *metric, const Metrics::History &history) const
     {
-        auto value = metric_value;
-        if (c.delta_mode) {
-            value = c.lastValue ? metric_value - c.lastValue : 0;
-            Y_LOG(100, " metric_value:" << metric_value << " value:" << value << c.tostring());
-            c.lastValue = metric_value;
-        } else
-            Y_LOG(100, " value:" << value << c.tostring());
+        auto id = metric->series_id;
+        switch (func) {
+            case Function::Value: return metric->value();
+            case Function::Delta: return history.delta(id);
+            case Function::Rate: return std::llround(history.rate(id, window));
+            case Function::Avg: return std::llround(history.avg(id, window));
+            case Function::Min: return history.min(id, window);
+            case Function::Max: return history.max(id, window);
+            case Function::Percentile: return history.percentile(id, percentile, window);
+            case Function::Quantile: return metric->quantile(percentile / 100);
+        }
+        return metric->value();
+    }
 
-        switch (c.type) {
-            case ConditionType::Greater: return value > c.value;
-            case ConditionType::Less: return value < c.value;
-            case ConditionType::Equal: return value == c.value;
-            case ConditionType::Range: return value >= c.min_value && value <= c.max_value;
-            case ConditionType::GreaterEqual: return value >= c.value;
-            case ConditionType::LessEqual: return value <= c.value;
-            case ConditionType::Error: break;
+    size_t Condition::historyDepth() const
+    {
+        switch (func) {
+            case Function::Value:
+            case Function::Quantile: return 0;
+            case Function::Delta: return 2;
+            case Function::Rate: return std::max<size_t>(window, 2);
+            default: return window;
         }
-        return false;
     }
 
     std::string Condition::tostring()
     {
         auto res = " condition:" + text.value + " delta_mode: " + std::to_string(delta_mode.value);
-        if (lastValue) res += " lastValue:" + std::to_string(lastValue);
+        if (func != Function::Value && func != Function::Delta) res += " function:" + function.value;
         return res;
     }
 
-    std::string format_duration(std::chrono::steady_clock::duration d)
-    {
-        auto days = std::chrono::duration_cast<std::chrono::days>(d);
-        d -= days;
-        auto hours = std::chrono::duration_cast<std::chrono::hours>(d);
-        d -= hours;
-        auto minutes = std::chrono::duration_cast<std::chrono::minutes>(d);
-        d -= minutes;
-        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(d);
-        d -= seconds;
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(d);
-        std::ostringstream oss;
-        oss << std::setfill('0');
-        if (days.count() > 0) oss << days.count() << "д ";
-        if (hours.count()) oss << hours.count() << "ч ";
-        if (minutes.count()) oss << minutes.count() << "м ";
-        if (seconds.count()) oss << seconds.count() << "с ";
-        if (ms.count()) oss << ms.count() << "мс";
-        return oss.str();
-    }
-
-    std::string Notify::formatAlertMessage(const std::string &tmpl, Metrics::Metric *metric)
-    {
-        std::string msg = tmpl;
-        boost::replace_all(msg, "{metric}", metric->name);
-        boost::replace_all(msg, "{duration}", format_duration(std::chrono::steady_clock::now() - start_));
-        boost::replace_all(msg, "{value}", std::to_string(metric->value_));
-        size_t pos = msg.find("{tags}");
-        if (pos != std::string::npos) {
-            std::string tags;
-            for (const auto &t : metric->tags) {
-                if (!tags.empty()) tags += ",";
-                tags += t.first + "=" + t.second;
-            }
-            msg.replace(pos, 6, tags);
+    void Notify::formatAlertMessage(std::string &out, const AlertTemplate &tmpl, const Metrics::SeriesKey &key,
+                                    size_t value) const
+    {
+        auto duration = tmpl.hasDuration() ? AlertTemplate::Clock::now() - start_ : AlertTemplate::Clock::duration{};
+        tmpl.render(out, key, value, duration);
+    }
+
+    namespace
+    {
+        using Intervals = std::vector<std::pair<size_t, size_t>>;
+
+        constexpr size_t max_size = std::numeric_limits<size_t>::max();
+
+        std::string_view trim(std::string_view s)
+        {
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+            return s;
         }
-        pos = 0;
-        while ((pos = msg.find("{tag:", pos)) != std::string::npos) {
-            size_t pos_end = msg.find("}", pos);
-            if (pos_end == std::string::npos) break;
-            std::string key = msg.substr(pos + 5, pos_end - (pos + 5));
-            auto res = std::ranges::find_if(metric->tags, [=](const Metrics::Tag &val) { return val.first == key; });
-            if (res != metric->tags.end()) {
-                msg.replace(pos, pos_end - pos + 1, res->second);
-                pos += res->second.length(); // Продолжаем поиск после замены
-            } else
-                pos = pos_end + 1; // Пропускаем если тег не найден
+
+        std::vector<std::string_view> split(std::string_view s, std::string_view sep)
+        {
+            std::vector<std::string_view> parts;
+            for (size_t pos; (pos = s.find(sep)) != std::string_view::npos; s.remove_prefix(pos + sep.size()))
+                parts.push_back(trim(s.substr(0, pos)));
+            parts.push_back(trim(s));
+            return parts;
+        }
+
+        Intervals intersect(const Intervals &a, const Intervals &b)
+        {
+            Intervals res;
+            for (auto [a_min, a_max] : a)
+                for (auto [b_min, b_max] : b)
+                    if (std::max(a_min, b_min) <= std::min(a_max, b_max))
+                        res.emplace_back(std::max(a_min, b_min), std::min(a_max, b_max));
+            return res;
         }
-        return msg;
     }
 
-    void Condition::init()
+    /// Разбирает одно сравнение и возвращает его отрезки, для одиночного условия заполняет type/value как раньше
+    bool parse_atom(Condition &c, std::string_view s, Intervals &res)
     {
-        auto &s = text.value;
-        if (s.empty()) return;
+        if (s.empty()) return false;
+        auto number = [&](size_t prefix) { return std::stoul(std::string(s.substr(prefix))); };
         if (s.front() == '[' && s.back() == ']') {
             auto sep = s.find(';');
-            if (sep == std::string::npos) return;
+            if (sep == std::string_view::npos) return false;
             try {
-                min_value = std::stod(s.substr(1, sep - 1));
-                max_value = std::stod(s.substr(sep + 1, s.size() - sep - 2));
-                if (min_value > max_value) return;
-                type = ConditionType::Range;
+                c.min_value = std::stod(std::string(s.substr(1, sep - 1)));
+                c.max_value = std::stod(std::string(s.substr(sep + 1, s.size() - sep - 2)));
             } catch (...) {
+                return false;
             }
-            return;
+            if (c.min_value > c.max_value) return false;
+            c.type = ConditionType::Range;
+            res    = {{c.min_value, c.max_value}};
+            return true;
         }
         if (s.starts_with(">=")) {
-            type  = ConditionType::GreaterEqual;
-            value = std::stoul(s.substr(2));
-            return;
-        }
-        if (s.starts_with("<=")) {
-            type  = ConditionType::LessEqual;
-            value = std::stoul(s.substr(2));
-            return;
-        };
-        if (s.starts_with(">")) {
-            type  = ConditionType::Greater;
-            value = std::stoul(s.substr(1));
-            return;
-        };
-        if (s.starts_with("<")) {
-            type  = ConditionType::Less;
-            value = std::stoul(s.substr(1));
-            return;
-        };
-        if (s.starts_with("=")) {
-            type  = ConditionType::Equal;
-            value = std::stoul(s.substr(1));
-            return;
-        };
-        return;
-    }
-
-    void NotifyManager::upload(std::set<Metrics::Metric *> &statistics)
-    {
-        if (alert_providers.empty()) return;
-        std::vector<std::string> alerts;
-        for (auto metric : statistics) {
-            auto notifier = notifiers_map.find(metric->name);
-            if (notifier == notifiers_map.end()) continue;
-            if (!notifier->second->tags.items.empty() &&
-                !std::all_of(notifier->second->tags.items.begin(), notifier->second->tags.items.end(),
-                             [&](const auto &nt) {
-                                 return std::any_of(metric->tags.begin(), metric->tags.end(),
-                                                    [&](const Metrics::Tag &mt) { return mt.second == *nt; });
-                             })) {
+            c.type  = ConditionType::GreaterEqual;
+            c.value = number(2);
+            res     = {{c.value, max_size}};
+        } else if (s.starts_with("<=")) {
+            c.type  = ConditionType::LessEqual;
+            c.value = number(2);
+            res     = {{0, c.value}};
+        } else if (s.starts_with("!=")) {
+            c.type  = ConditionType::NotEqual;
+            c.value = number(2);
+            res.clear();
+            if (c.value > 0) res.emplace_back(0, c.value - 1);
+            if (c.value < max_size) res.emplace_back(c.value + 1, max_size);
+        } else if (s.starts_with(">")) {
+            c.type  = ConditionType::Greater;
+            c.value = number(1);
+            res.clear();
+            if (c.value < max_size) res.emplace_back(c.value + 1, max_size);
+        } else if (s.starts_with("<")) {
+            c.type  = ConditionType::Less;
+            c.value = number(1);
+            res.clear();
+            if (c.value > 0) res.emplace_back(0, c.value - 1);
+        } else if (s.starts_with("=")) {
+            c.type  = ConditionType::Equal;
+            c.value = number(1);
+            res     = {{c.value, c.value}};
+        } else
+            return false;
+        return true;
+    }
+
+    /// "rate(5)", "p99(20)", "quantile(0.99)" -> функция и окно, false если запись не распознана
+    bool parse_function(Condition &c, std::string_view s)
+    {
+        using Function = Condition::Function;
+        s = trim(s);
+        if (c.delta_mode || s == "delta") {
+            c.func = Function::Delta;
+            return true;
+        }
+        if (s.empty() || s == "value") {
+            c.func = Function::Value;
+            return true;
+        }
+        auto open = s.find('(');
+        if (open == std::string_view::npos || s.back() != ')') return false;
+        auto name = s.substr(0, open);
+        auto arg  = std::string(s.substr(open + 1, s.size() - open - 2));
+        if (name == "quantile") {
+            c.func       = Function::Quantile;
+            c.percentile = std::stod(arg) * 100;
+            return c.percentile >= 0 && c.percentile <= 100;
+        }
+        if (name == "rate") c.func = Function::Rate;
+        else if (name == "avg") c.func = Function::Avg;
+        else if (name == "min") c.func = Function::Min;
+        else if (name == "max") c.func = Function::Max;
+        else if (name.size() > 1 && name.front() == 'p') {
+            c.func       = Function::Percentile;
+            c.percentile = std::stod(std::string(name.substr(1)));
+        } else
+            return false;
+        c.window = std::stoul(arg);
+        return c.window > 0 && c.window <= Metrics::History::max_depth;
+    }
+
+    void Condition::init()
+    {
+        type = ConditionType::Error;
+        intervals.clear();
+        if (text.value.empty() || !parse_function(*this, function.value)) return;
+        // Условие приводится к дизъюнкции конъюнкций: && пересекает отрезки, || объединяет
+        auto disjuncts = split(text.value, "||");
+        for (auto disjunct : disjuncts) {
+            auto atoms = split(disjunct, "&&");
+            Intervals all = {{0, max_size}};
+            for (auto atom : atoms) {
+                Intervals res;
+                if (!parse_atom(*this, atom, res)) {
+                    type = ConditionType::Error;
+                    intervals.clear();
+                    return;
+                }
+                all = intersect(all, res);
+            }
+            intervals.insert(intervals.end(), all.begin(), all.end());
+        }
+        if (disjuncts.size() > 1 || split(text.value, "&&").size() > 1) type = ConditionType::Compound;
+    }
+
+    std::vector<Notify *> NotifyManager::match(Metrics::Metric *metric)
+    {
+        std::vector<Notify *> res;
+        auto key = metric->key();
+        if (!key) return res;
+        auto notifiers = notifiers_by_hash.find(Metrics::hashBytes(key->name));
+        if (notifiers == notifiers_by_hash.end()) return res;
+        uint64_t mask = 0;
+        for (auto &[name, value] : key->tags)
+            if (auto bit = tag_bits.find(value); bit != tag_bits.end()) mask |= bit->second;
+        for (auto notify : notifiers->second) {
+            if (notify->metric.value != key->name || (mask & notify->tags_mask) != notify->tags_mask) continue;
+            if (notify->tags_unindexed &&
+                !std::all_of(notify->tags.items.begin(), notify->tags.items.end(), [&](const auto &nt) {
+                    return std::any_of(key->tags.begin(), key->tags.end(),
+                                       [&](const Metrics::TagView &mt) { return mt.second == *nt; });
+                }))
                 continue;
+            res.push_back(notify);
+        }
+        return res;
+    }
+
+    void NotifyManager::bind(const Metrics::Registry &registry)
+    {
+        auto version = registry.version();
+        if (version == registry_version && (!expire_at || tick < expire_at)) return;
+        registry_version = version;
+        // Правило ищется лишь для метрик, появившихся в слоте с прошлой привязки
+        slots.resize(registry.top());
+        for (auto &group : groups) group.bindings.clear();
+        bind_round++;
+        for (uint32_t i = 0; i < slots.size(); i++) {
+            auto metric = registry.at(i);
+            auto &slot  = slots[i];
+            if (slot.metric != metric || (metric && slot.series_id != metric->series_id))
+                slot = {metric, metric ? metric->series_id : Metrics::KeyTable::no_id,
+                        metric ? match(metric) : std::vector<Notify *>{}};
+            for (auto notify : slot.rules) {
+                auto [state, bound] = notify->alert_states.bind(metric->series_id, bind_round);
+                if (bound == AlertStateTable::Bind::Repeated) continue;
+                groups[notify->group].bindings.emplace_back(metric, notify);
+                if (bound != AlertStateTable::Bind::New || !restored) continue;
+                if (auto saved = restored->claimAlert(*metric->key(), notify->rule_hash)) {
+                    state->current = saved->current;
+                    state->total   = saved->total;
+                    state->window  = saved->window;
+                    state->firing  = saved->firing;
+                }
+            }
+        }
+        // Состояния пропавших серий живут state_ttl тактов: метрика, созданная заново, продолжит их
+        size_t bytes = 0, waiting = 0;
+        for (auto &[name, notify] : notifiers_map) {
+            waiting += notify->alert_states.expire(bind_round, tick, state_ttl);
+            bytes += notify->alert_states.bytes();
+        }
+        // Реестр может больше не меняться: привязка повторяется, когда истечет срок ожидающих
+        expire_at = waiting ? tick + std::max<uint32_t>(state_ttl, 1) : 0;
+        state_bytes = bytes;
+        for (auto &group : groups) {
+            group.batch.clear();
+            group.states.clear();
+            group.collect.clear();
+            for (auto [metric, notify] : group.bindings) {
+                group.batch.add(notify->condition.intervals);
+                group.states.push_back(notify->alert_states.find(metric->series_id));
+                if (group.interval_ms) group.collect.push_back(metric->collector());
+            }
+            // Серии одной гистограммы собираются одним ее collect()
+            std::ranges::sort(group.collect);
+            group.collect.erase(std::unique(group.collect.begin(), group.collect.end()), group.collect.end());
+            group.active.assign(group.batch.words(), 0);
+            for (size_t i = 0; i < group.states.size(); i++)
+                if (group.states[i]->window || group.states[i]->firing) group.active[i / 64] |= uint64_t(1) << (i % 64);
+        }
+    }
+
+    std::vector<Metrics::SnapshotFile::Alert> NotifyManager::exportAlerts(const Metrics::Registry &registry)
+    {
+        bind(registry);
+        std::vector<Metrics::SnapshotFile::Alert> alerts;
+        for (auto &group : groups)
+            for (size_t i = 0; i < group.bindings.size(); i++) {
+                auto [metric, notify] = group.bindings[i];
+                auto &state           = *group.states[i];
+                if (state.window || state.firing || state.total)
+                    alerts.push_back({metric->series_hash, notify->rule_hash, state.window, state.current, state.total,
+                                      metric->series_id, state.firing});
             }
-            auto &[current_count, current_total_count] = notifier->second->alerts_count[metric];
-
-            if (check_condition(notifier->second->condition, metric->value_)) {
-                if (current_count == 0) notifier->second->start_ = std::chrono::steady_clock::now();
-                current_count++;
-                current_total_count++;
-                Y_LOG(100, "condition checked: " << notifier->second->condition.tostring() << "alert count "
-                                                 << current_count << " for metric: " << metric->toString(false));
-                if (current_count == notifier->second->alert_count) {
-                    Y_LOG(100, "alert start : " << notifier->second->condition.tostring()
-                                                << " for metric: " << metric->toString(false));
-                    alerts.emplace_back(
-                        notifier->second->formatAlertMessage(notifier->second->alertStartMessage, metric));
-                    (*notifier->second->alert_count_in_period)++;
+        return alerts;
+    }
+
+    size_t NotifyManager::historyDepth() const
+    {
+        size_t depth = 0;
+        for (auto &[name, notify] : notifiers_map) depth = std::max(depth, notify->condition.historyDepth());
+        return depth;
+    }
+
+    std::vector<uint32_t> NotifyManager::groupIntervals() const
+    {
+        std::vector<uint32_t> intervals;
+        for (auto &group : groups) intervals.push_back(group.interval_ms);
+        return intervals;
+    }
+
+    NotifyManager::Messages NotifyManager::upload(const Metrics::Registry &registry, const Metrics::History &history,
+                                                  size_t group_index)
+    {
+        Messages messages;
+        if (alert_providers.empty()) return messages;
+        if (group_index == 0) tick++;
+        bind(registry);
+        auto &[interval_ms, bindings, batch, states, hits, active, collect] = groups[group_index];
+        for (auto metric : collect) metric->collect();
+        auto &alerts = messages.alerts;
+        std::shared_lock<std::shared_mutex> lock(history.mutex());
+        auto values = batch.values();
+        for (size_t i = 0; i < bindings.size(); i++)
+            values[i] = bindings[i].second->condition.evaluate(bindings[i].first, history);
+        hits.resize(batch.words());
+        batch.evaluate(hits);
+        // Ложное условие при нулевом состоянии ничего не меняет, такие полосы пропускаются
+        for (size_t word = 0; word < hits.size(); word++)
+            for (auto lanes = hits[word] | active[word]; lanes; lanes &= lanes - 1) {
+                size_t bit            = std::countr_zero(lanes);
+                auto [metric, notify] = bindings[word * 64 + bit];
+                auto &state           = *states[word * 64 + bit];
+                bool hit              = hits[word] >> bit & 1;
+                state.window          = state.window << 1 | hit;
+                if (hit) {
+                    if (state.current == 0) notify->start_ = std::chrono::steady_clock::now();
+                    state.current++;
+                    state.total++;
+                    state.value = metric->value();
+                    Y_LOG(100, "condition checked: " << notify->condition.tostring() << "alert count " << state.current
+                                                     << " for metric: " << metric->toString(false));
+                } else
+                    state.current = 0;
+
+                size_t need = std::max<size_t>(notify->alert_count, 1);
+                bool firing = state.current >= need;
+                if (notify->alert_window) {
+                    auto mask = notify->alert_window >= 64 ? ~uint64_t(0) : (uint64_t(1) << notify->alert_window) - 1;
+                    firing    = size_t(std::popcount(state.window & mask)) >= need;
                 }
-            } else {
-                if (current_count >= notifier->second->alert_count) {
-                    Y_LOG(100, "alert stop : " << notifier->second->condition.tostring()
-                                               << " for metric: " << metric->toString(false));
-                    alerts.emplace_back(
-                        notifier->second->formatAlertMessage(notifier->second->alertStoppedMessage, metric));
+                if (firing && !state.firing) {
+                    Y_LOG(100, "alert start : " << notify->condition.tostring() << " for metric: " << metric->toString(false));
+                    message.clear();
+                    notify->formatAlertMessage(message, notify->start_template, *metric->key(), metric->value());
+                    alerts.push_back(message);
+                    (*notify->alert_count_in_period)++;
+                } else if (!firing && state.firing) {
+                    Y_LOG(100, "alert stop : " << notify->condition.tostring() << " for metric: " << metric->toString(false));
+                    message.clear();
+                    notify->formatAlertMessage(message, notify->stopped_template, *metric->key(), metric->value());
+                    alerts.push_back(message);
                 }
-                current_count = 0;
+                state.firing = firing;
+                if (state.window || state.firing) active[word] |= uint64_t(1) << bit;
+                else active[word] &= ~(uint64_t(1) << bit);
             }
-        }
-        for (auto &alert : alerts)
-            for (auto &provider : alert_providers) provider->alert(alert);
-        reporter();
+        lock.unlock();
+        if (group_index == 0) messages.report = reporter();
+        return messages;
     }
 
     void NotifyManager::init()
     {
+        groups.resize(1);
         try {
             for (auto &n : notifiers.items) {
                 if (n->metric.value.empty()) continue;
@@ -197,9 +385,23 @@ namespace NotifierSystem
                 }
                 std::string tags_joined = "";
                 for (auto &t : n->tags.items) tags_joined += (tags_joined.size() ? ", " : "") + *t;
+                n->rule_hash = Metrics::hashBytes(n->metric.value + '\0' + n->condition.text.value + '\0' +
+                                                  n->condition.function.value + '\0' + tags_joined);
+                n->start_template.compile(n->alertStartMessage.value);
+                n->stopped_template.compile(n->alertStoppedMessage.value);
                 n->alert_count_in_period = std::make_unique<Metrics::Counter>(
                     "Notify_count_in_period",
                     std::vector<Metrics::Tag>{{"metric", n->metric.value}, {"tags", tags_joined}});
+                for (auto &t : n->tags.items) {
+                    auto bit = tag_bits.size() < 64 ? uint64_t(1) << tag_bits.size() : 0;
+                    auto it  = tag_bits.try_emplace(*t, bit).first;
+                    n->tags_mask |= it->second;
+                    if (!it->second) n->tags_unindexed = true;
+                }
+                auto group = std::ranges::find(groups, uint32_t(n->interval_ms), &Group::interval_ms);
+                n->group   = group - groups.begin();
+                if (group == groups.end()) groups.emplace_back().interval_ms = n->interval_ms;
+                notifiers_by_hash[Metrics::hashBytes(n->metric.value)].push_back(n.get());
                 notifiers_map.emplace(n->metric.value, std::move(n));
             }
             notifiers.items.clear();
@@ -212,28 +414,29 @@ namespace NotifierSystem
         report.last_sended_report = std::chrono::steady_clock::now() - std::chrono::hours(report.periodHours.value);
     }
 
-    void NotifyManager::reporter()
+    std::string NotifyManager::reporter()
     {
-        if (!report.needSend) return;
+        if (!report.needSend) return "";
         G_LOG(50, "Report check");
         if (std::chrono::steady_clock::now() - report.last_sended_report < std::chrono::hours(report.periodHours.value))
-            return;
+            return "";
         report.last_sended_report = std::chrono::steady_clock::now();
         std::string conditions = "", alerts = "";
         for (auto &alert : notifiers_map) {
             alerts += "\n        " + std::to_string(*alert.second->alert_count_in_period) + " : " +
                       alert.second->metric.value + " " + alert.second->condition.tostring();
             alert.second->alert_count_in_period->exchange();
-            for (auto &[metric, condition_count] : alert.second->alerts_count)
-                if (condition_count.second) {
-                    conditions += "\n        " + std::to_string(condition_count.second) + " : " +
-                                  alert.second->formatAlertMessage(alert.second->alertStartMessage, metric);
-                    condition_count.second = 0;
-                }
+            alert.second->alert_states.forEach([&](uint32_t series_id, AlertState &state) {
+                if (!state.total) return;
+                conditions += "\n        " + std::to_string(state.total) + " : ";
+                alert.second->formatAlertMessage(conditions, alert.second->start_template, (*keys)[series_id],
+                                                 state.value);
+                state.total = 0;
+            });
         }
         auto report_text = report.headText.value + "\n" + report.alertText.value + alerts + "\n" +
                            report.conditionText.value + conditions;
-        for (auto &provider : alert_providers) provider->alert(report_text);
         G_LOG(50, "Report:" << report_text);
+        return report_text;
     }
 }
\ No newline at end of file
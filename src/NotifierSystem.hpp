@@ -1,13 +1,24 @@
 #pragma once
+#include "AlertStateTable.hpp"
+#include "AlertTemplate.hpp"
+#include "ConditionBatch.hpp"
 #include "Metrics.hpp"
+#include "MetricsHistory.hpp"
+#include "MetricsRegistry.hpp"
+#include "MetricsSnapshotFile.hpp"
 #include <boost/property_tree/ptree_fwd.hpp>
+#include <atomic>
 #include <cstddef>
 #include <map>
 #include <memory>
 #include <set>
+#include <unordered_map>
+#include <vector>
 #include <chrono>
 #include <BaseConfig>
 
+struct MetricsModelProbe;
+
 namespace NotifierSystem
 {
 
@@ -18,21 +29,40 @@ namespace NotifierSystem
         virtual ~NotifierProvider()             = default;
     };
 
-    enum class ConditionType { Greater, Less, GreaterEqual, LessEqual, Equal, Range, Error };
+    enum class ConditionType { Greater, Less, GreaterEqual, LessEqual, Equal, NotEqual, Range, Compound, Error };
 
     struct Condition {
         Condition(d3156::Config *parent)
-            : text("condition", "", "string", parent), delta_mode("delta_mode", false, "bool", parent)
+            : text("condition", "", "string", parent), delta_mode("delta_mode", false, "bool", parent),
+              function("function", "value", "string", parent)
         {
         }
-        d3156::ConfigString text;
+        d3156::ConfigString text; /// ">=80", "[10;20]", "!=0", условия объединяются через && и ||
         ConditionType type = ConditionType::Error;
-        size_t value;     // для > < >= <= =
+        size_t value;     // для > < >= <= = !=
         size_t min_value; // для Range
         size_t max_value; // для Range
 
-        d3156::ConfigBool delta_mode;
-        size_t lastValue = 0;
+        /// Условие, скомпилированное в объединение отрезков [min, max]: истинно, если значение попадает в любой
+        std::vector<std::pair<size_t, size_t>> intervals;
+        bool check(size_t value) const
+        {
+            bool res = false;
+            for (auto [min, max] : intervals) res |= value >= min && value <= max;
+            return res;
+        }
+
+        d3156::ConfigBool delta_mode; /// То же, что function = "delta"
+
+        /// Над чем проверяется условие: value, delta, rate(N), avg(N), min(N), max(N), pXX(N) — по N последним тактам,
+        /// quantile(0.99) — по корзинам Histogram за все время
+        d3156::ConfigString function;
+        enum class Function { Value, Delta, Rate, Avg, Min, Max, Percentile, Quantile } func = Function::Value;
+        size_t window     = 1;
+        double percentile = 0;
+        size_t historyDepth() const; /// Сколько тактов истории нужно функции
+        size_t evaluate(const Metrics::Metric *metric, const Metrics::History &history) const;
+
         std::string tostring();
 
         void init();
@@ -44,26 +74,87 @@ namespace NotifierSystem
         Condition condition;
         CONFIG_STRING(metric, "");
         CONFIG_UINT(alert_count, 0);     /// Количество повторов для срабатывания
+        CONFIG_UINT(alert_window, 0);    /// Если не 0: срабатывание при alert_count совпадениях из alert_window тактов
+        CONFIG_UINT(interval_ms, 0);     /// Если не 0: правило проверяется своим расписанием, а не на такте модели
         CONFIG_ARRAY(tags, std::string); // optional
         CONFIG_STRING(alertStartMessage, "Alert! {metric}:{value} {tags}");
         CONFIG_STRING(alertStoppedMessage, "Alert stopped! {metric}:{value} {tags}");
 
+        uint64_t rule_hash  = 0;     /// Хэш метрики, условия, функции и тегов: правило в сохраненном снимке
+        uint64_t tags_mask  = 0;     /// Биты значений из tags в NotifyManager::tag_bits
+        bool tags_unindexed = false; /// Не все значения tags получили бит, проверяются строками
+        size_t group        = 0;     /// Номер в NotifyManager::groups
+
         std::chrono::time_point<std::chrono::steady_clock> start_;
-        std::string formatAlertMessage(const std::string &tmpl, Metrics::Metric *metric);
+        AlertTemplate start_template, stopped_template; /// alertStartMessage и alertStoppedMessage, разобранные в init
+        /// Дописывает в out сообщение по шаблону для серии key
+        void formatAlertMessage(std::string &out, const AlertTemplate &tmpl, const Metrics::SeriesKey &key,
+                                size_t value) const;
         std::unique_ptr<Metrics::Counter> alert_count_in_period;
-        std::map<Metrics::Metric *, std::pair<size_t, size_t>> alerts_count;
+
+        AlertStateTable alert_states; /// По series_id
     };
 
     class NotifyManager
     {
         friend class ::MetricsModel;
-        std::unordered_map<std::string, std::unique_ptr<Notify>> notifiers_map;
+        friend struct ::MetricsModelProbe;
+        std::unordered_multimap<std::string, std::unique_ptr<Notify>> notifiers_map; /// Несколько правил на метрику
         std::set<NotifierProvider *> alert_providers;
         NotifyManager(d3156::Config *parent) : report(parent), notifiers("notifiers", parent) {}
-        void upload(std::set<Metrics::Metric *> &statistics);
-        void reporter();
+        /// Сообщения такта: отправляет MetricsModel через AlertQueue провайдеров
+        struct Messages {
+            std::vector<std::string> alerts;
+            std::string report; /// Пусто, если время отчета не пришло
+        };
+        /// Проверка правил группы, вызывать под Metrics::Registry::Walk. Отчет — только с группой 0.
+        /// Группа со своим интервалом сама сливает шарды своих серий, группу 0 собирает такт модели
+        Messages upload(const Metrics::Registry &registry, const Metrics::History &history, size_t group = 0);
+        /// Интервалы групп правил после init, интервал группы 0 — такт модели
+        std::vector<uint32_t> groupIntervals() const;
+        size_t historyDepth() const; /// Глубина истории, нужная функциям условий
+        /// Состояния оповещений для SnapshotFile, вызывать под Metrics::Registry::Walk
+        std::vector<Metrics::SnapshotFile::Alert> exportAlerts(const Metrics::Registry &registry);
+        const Metrics::SnapshotFile *restored = nullptr; /// Состояния, сохраненные до перезапуска
+        std::string reporter();
         void init();
 
+        /// Правила привязываются к сериям один раз, при первом появлении метрики в слоте реестра.
+        /// Такт проходит только по привязанным парам (метрика, правило).
+        std::vector<Notify *> match(Metrics::Metric *metric);
+        void bind(const Metrics::Registry &registry);
+        std::unordered_map<uint64_t, std::vector<Notify *>> notifiers_by_hash; /// hashBytes(metric) -> правила
+        /// Значение тега из правил -> бит маски; поиск по string_view тегов ключа серии
+        std::unordered_map<std::string, uint64_t, Metrics::NameHash, std::equal_to<>> tag_bits;
+        struct Slot {
+            Metrics::Metric *metric = nullptr;
+            uint32_t series_id      = Metrics::KeyTable::no_id; /// Адрес удаленной метрики может достаться новой
+            std::vector<Notify *> rules;
+        };
+        std::vector<Slot> slots; /// По слотам реестра при привязке
+        /// Правила с одинаковым Notify::interval_ms проверяются вместе, по своему расписанию MetricsModel.
+        /// Полосы batch, states, hits и active идут в порядке bindings
+        struct Group {
+            uint32_t interval_ms = 0;                                     /// 0 — такт модели
+            std::vector<std::pair<Metrics::Metric *, Notify *>> bindings; /// Пары (серия, правило), по одной на серию
+            ConditionBatch batch;
+            std::vector<AlertState *> states; /// В Notify::alert_states, действительны до следующей привязки
+            std::vector<uint64_t> hits;       /// Результаты условий на такте
+            std::vector<uint64_t> active; /// Состояние не нулевое: полоса обновляется, даже если условие ложно
+            /// Только у групп со своим интервалом: метрики, чей collect() выставляет значения серий группы.
+            /// Реестр на их такте целиком не собирается
+            std::vector<Metrics::Metric *> collect;
+        };
+        std::vector<Group> groups; /// groups[0] — правила без своего интервала, проверяются на такте модели
+        std::string message;       /// Буфер сообщения оповещения, память переиспользуется между тактами
+        uint64_t registry_version       = UINT64_MAX;
+        uint32_t tick                   = 0;       /// Такты upload группы 0
+        uint32_t bind_round             = 0;
+        uint32_t expire_at              = 0;       /// Такт повторной привязки для удаления состояний, 0 — не нужна
+        uint32_t state_ttl              = 0;       /// Тактов до удаления состояния пропавшей серии
+        std::atomic<size_t> state_bytes = 0;       /// Память Notify::alert_states, для MetricsModel::memoryUsage
+        const Metrics::KeyTable *keys   = nullptr; /// Ключи серий для отчета
+
         struct Report : public d3156::Config {
             Report(d3156::Config *parent) : d3156::Config("report", parent) {}
             CONFIG_UINT(periodHours, 12);
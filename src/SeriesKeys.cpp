@@ -0,0 +1,163 @@
+#include "SeriesKeys.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace Metrics
+{
+
+    KeyTable::~KeyTable()
+    {
+        for (auto &chunk : chunks_) delete[] chunk.load();
+        for (auto &shard : shards_)
+            for (auto block : shard.blocks) delete[] block;
+    }
+
+    void *KeyTable::Shard::allocate(size_t size, size_t align, std::atomic<size_t> &bytes)
+    {
+        used = (used + align - 1) / align * align;
+        if (used + size > arena_block) {
+            blocks.push_back(new char[std::max(size, arena_block)]);
+            bytes.fetch_add(std::max(size, arena_block), std::memory_order_relaxed);
+            used = 0;
+        }
+        auto ptr = blocks.back() + used;
+        used += size;
+        return ptr;
+    }
+
+    KeyTable::Interned KeyTable::intern(std::string_view name, const std::vector<Tag> &tags, bool limited)
+    {
+        std::vector<TagView> sorted(tags.begin(), tags.end());
+        std::ranges::stable_sort(sorted, {}, &TagView::first);
+        return intern(name, sorted, KeyTable::hash(name, sorted), limited);
+    }
+
+    KeyTable::Interned KeyTable::intern(std::string_view name, std::span<const TagView> sorted, uint64_t hash,
+                                        bool limited)
+    {
+        auto &shard = shards_[hash % shards];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto [it, end] = shard.ids.equal_range(hash); it != end; ++it) {
+            auto &key = (*this)[it->second];
+            if (key.name == name && std::ranges::equal(key.tags, sorted))
+                return {acquire(it->second, limited) ? it->second : no_id, hash};
+        }
+        {
+            std::lock_guard<std::mutex> names_lock(names_mutex_);
+            if (!admit(name, limited)) return {no_id, hash};
+        }
+
+        // Теги и их текст указывают внутрь полного ключа, отдельно хранится только "k=v,k2=v2" для нескольких тегов
+        std::string text(name), tags_text;
+        std::vector<std::pair<size_t, size_t>> offsets;
+        if (sorted.size()) text += " tags=";
+        for (size_t i = 0; i < sorted.size(); i++) {
+            if (i) text += ", ";
+            offsets.emplace_back(text.size(), text.size() + sorted[i].first.size() + 1);
+            text += std::string(sorted[i].first) + "=" + std::string(sorted[i].second);
+            tags_text += std::string(i ? "," : "") + std::string(sorted[i].first) + "=" + std::string(sorted[i].second);
+        }
+        auto store = [&](std::string_view s) {
+            auto ptr = static_cast<char *>(shard.allocate(s.size(), 1, bytes_));
+            std::memcpy(ptr, s.data(), s.size());
+            return std::string_view(ptr, s.size());
+        };
+        SeriesKey key;
+        key.hash      = hash;
+        key.key       = store(text);
+        key.name      = key.key.substr(0, name.size());
+        key.tags_text = sorted.size() > 1 ? store(tags_text) : key.key.substr(key.key.size() - tags_text.size());
+        auto views    = static_cast<TagView *>(shard.allocate(sizeof(TagView) * sorted.size(), alignof(TagView), bytes_));
+        for (size_t i = 0; i < sorted.size(); i++)
+            new (&views[i]) TagView(key.key.substr(offsets[i].first, sorted[i].first.size()),
+                                    key.key.substr(offsets[i].second, sorted[i].second.size()));
+        key.tags = {views, sorted.size()};
+
+        uint32_t id = size_.fetch_add(1, std::memory_order_acq_rel);
+        if (id >= chunk_size * max_chunks) throw std::length_error("Metrics::KeyTable is full");
+        auto &chunk = chunks_[id / chunk_size];
+        if (!chunk.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> chunk_lock(chunks_mutex_);
+            if (!chunk.load(std::memory_order_relaxed)) {
+                chunk.store(new Slot[chunk_size], std::memory_order_release);
+                bytes_.fetch_add(sizeof(Slot) * chunk_size, std::memory_order_relaxed);
+            }
+        }
+        auto &slot = chunk.load(std::memory_order_acquire)[id % chunk_size];
+        slot.key   = key;
+        slot.refs.store(1, std::memory_order_relaxed);
+        shard.ids.emplace(hash, id);
+        bytes_.fetch_add(sizeof(std::pair<uint64_t, uint32_t>) + 2 * sizeof(void *), std::memory_order_relaxed);
+        return {id, hash};
+    }
+
+    void KeyTable::setLimits(size_t max_series, size_t max_per_name)
+    {
+        std::lock_guard<std::mutex> lock(names_mutex_);
+        max_series_   = max_series;
+        max_per_name_ = max_per_name;
+    }
+
+    bool KeyTable::acquire(uint32_t id, bool limited)
+    {
+        auto &refs = slot(id).refs;
+        for (auto count = refs.load(std::memory_order_relaxed); count;)
+            if (refs.compare_exchange_weak(count, count + 1, std::memory_order_relaxed)) return true;
+        // С нуля счетчик поднимается только под names_mutex_, вместе с учетом серии в бюджетах
+        std::lock_guard<std::mutex> lock(names_mutex_);
+        if (!refs.load(std::memory_order_relaxed) && !admit((*this)[id].name, limited)) return false;
+        refs.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void KeyTable::release(uint32_t id)
+    {
+        if (slot(id).refs.fetch_sub(1, std::memory_order_relaxed) != 1) return;
+        // Между обнулением и блокировкой серия может быть снова учтена в acquire: admit видит ее еще не
+        // вычтенной и на это время строже к бюджету, итоговые счетчики сходятся
+        std::lock_guard<std::mutex> lock(names_mutex_);
+        admitted_--;
+        auto it = names_.find((*this)[id].name);
+        if (--it->second) return;
+        bytes_.fetch_sub(it->first.size() + sizeof(std::string) + sizeof(size_t) + 2 * sizeof(void *),
+                         std::memory_order_relaxed);
+        names_.erase(it);
+    }
+
+    size_t KeyTable::live() const
+    {
+        std::lock_guard<std::mutex> lock(names_mutex_);
+        return admitted_;
+    }
+
+    bool KeyTable::admit(std::string_view name, bool limited)
+    {
+        auto it      = names_.find(name);
+        size_t count = it == names_.end() ? 0 : it->second;
+        if (limited && ((max_series_ && admitted_ >= max_series_) || (max_per_name_ && count >= max_per_name_)))
+            return false;
+        admitted_++;
+        if (it != names_.end()) {
+            it->second++;
+            return true;
+        }
+        names_.emplace(name, 1);
+        bytes_.fetch_add(name.size() + sizeof(std::string) + sizeof(size_t) + 2 * sizeof(void *), std::memory_order_relaxed);
+        return true;
+    }
+
+    std::vector<std::pair<std::string, size_t>> KeyTable::seriesPerName(size_t limit) const
+    {
+        std::vector<std::pair<std::string, size_t>> res;
+        {
+            std::lock_guard<std::mutex> lock(names_mutex_);
+            res.assign(names_.begin(), names_.end());
+        }
+        limit = std::min(limit, res.size());
+        std::ranges::partial_sort(res, res.begin() + limit, std::greater<>{}, &std::pair<std::string, size_t>::second);
+        res.resize(limit);
+        return res;
+    }
+
+} // namespace Metrics
@@ -0,0 +1,125 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Metrics
+{
+
+    using Tag     = std::pair<std::string, std::string>;
+    using TagView = std::pair<std::string_view, std::string_view>;
+
+    /// FNV-1a, constexpr, чтобы ключи, известные при компиляции, хэшировались так же
+    constexpr uint64_t hashBytes(std::string_view data, uint64_t hash = 14695981039346656037ull)
+    {
+        for (char c : data) hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        return hash;
+    }
+
+    /// Для unordered_map<std::string, ..., NameHash, std::equal_to<>>: поиск по string_view без копии
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const { return hashBytes(name); }
+    };
+
+    /// Ключ серии: имя и отсортированные по ключу теги. Строки лежат в арене KeyTable и живут вместе с ней.
+    struct SeriesKey {
+        std::string_view key;       /// "name tags=k=v, k2=v2", как в Metric::toString(false)
+        std::string_view name;
+        std::string_view tags_text; /// "k=v,k2=v2", как в {tags} оповещений
+        std::span<const TagView> tags;
+        uint64_t hash = 0;
+    };
+
+    /// Интернирование ключей серий. Каждая пара (имя, теги) хэшируется и раскладывается в арену один раз,
+    /// метрики хранят только 32-битный id. Чтение по id без блокировок, добавление под мьютексом одного из шардов.
+    class KeyTable
+    {
+    public:
+        static constexpr uint32_t no_id = UINT32_MAX;
+
+        struct Interned {
+            uint32_t id   = no_id;
+            uint64_t hash = 0;
+        };
+
+        KeyTable() = default;
+        ~KeyTable();
+        KeyTable(const KeyTable &)            = delete;
+        KeyTable &operator=(const KeyTable &) = delete;
+
+        /// Возвращает id со взятой ссылкой на серию, вызывающий отпускает ее через release(id).
+        /// limited: серия без живых ссылок сверх setLimits() не учитывается, возвращается no_id
+        Interned intern(std::string_view name, const std::vector<Tag> &tags, bool limited = false);
+        /// Теги уже отсортированы по ключу и hash == hash(name, sorted_tags), например посчитаны при компиляции
+        Interned intern(std::string_view name, std::span<const TagView> sorted_tags, uint64_t hash,
+                        bool limited = false);
+
+        /// Еще одна ссылка на интернированную серию, false — серия без ссылок сверх бюджета при limited
+        bool acquire(uint32_t id, bool limited = false);
+        /// Отпускает ссылку из intern() или acquire(); серия без ссылок выходит из бюджетов, ключ и id остаются
+        void release(uint32_t id);
+
+        /// Бюджеты серий для intern(..., limited = true), 0 — без ограничения
+        void setLimits(size_t max_series, size_t max_per_name);
+        /// Серии с живыми ссылками
+        size_t live() const;
+        /// Количество живых серий по именам, по убыванию, не больше limit
+        std::vector<std::pair<std::string, size_t>> seriesPerName(size_t limit = SIZE_MAX) const;
+        const SeriesKey &operator[](uint32_t id) const { return slot(id).key; }
+        size_t size() const { return size_.load(std::memory_order_acquire); }
+        size_t bytes() const { return bytes_.load(std::memory_order_relaxed); } /// Арена, таблица ключей и индексы
+
+        static constexpr uint64_t hash(std::string_view name, std::span<const TagView> sorted_tags)
+        {
+            auto hash = hashBytes(name);
+            for (auto &[key, value] : sorted_tags) {
+                hash = hashBytes(std::string_view("\0", 1), hash);
+                hash = hashBytes(value, hashBytes("=", hashBytes(key, hash)));
+            }
+            return hash;
+        }
+
+    private:
+        static constexpr uint32_t chunk_size = 1024;
+        static constexpr uint32_t max_chunks = 16384;
+        static constexpr size_t arena_block  = 16 * 1024;
+        static constexpr size_t shards       = 16;
+
+        struct Shard {
+            std::mutex mutex;
+            std::unordered_multimap<uint64_t, uint32_t> ids;
+            std::vector<char *> blocks;
+            size_t used = arena_block;
+            void *allocate(size_t size, size_t align, std::atomic<size_t> &bytes);
+        };
+
+        struct Slot {
+            SeriesKey key;
+            std::atomic<uint32_t> refs = 0; /// Метрики серии и запись ImportTable
+        };
+        Slot &slot(uint32_t id) const { return chunks_[id / chunk_size].load()[id % chunk_size]; }
+
+        std::atomic<Slot *> chunks_[max_chunks] = {};
+        std::mutex chunks_mutex_;
+        std::atomic<uint32_t> size_ = 0;
+        std::atomic<size_t> bytes_  = 0;
+        std::array<Shard, shards> shards_;
+
+        /// Учитывает серию, у которой еще нет ссылок, false если сверх бюджета; под names_mutex_
+        bool admit(std::string_view name, bool limited);
+        mutable std::mutex names_mutex_;
+        std::unordered_map<std::string, size_t, NameHash, std::equal_to<>> names_; /// Имя -> количество живых серий
+        size_t admitted_     = 0; /// Живые серии
+        size_t max_series_   = 0;
+        size_t max_per_name_ = 0;
+    };
+
+} // namespace Metrics
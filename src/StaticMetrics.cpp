@@ -0,0 +1,82 @@
+#include "StaticMetrics.hpp"
+#include <string>
+
+namespace Metrics
+{
+
+    namespace
+    {
+        class StaticMirror : public Metric
+        {
+        public:
+            explicit StaticMirror(const StaticNode &node)
+                : Metric(std::string(node.name), std::vector<Tag>(node.tags.begin(), node.tags.end()), Deferred{}),
+                  value(node.value)
+            {
+                attach(node.tags, node.hash);
+            }
+            ~StaticMirror() { detach(); }
+            void collect() override { storeValue(value.load(std::memory_order_relaxed)); }
+
+        private:
+            const std::atomic<size_t> &value;
+        };
+    } // namespace
+
+    std::mutex &StaticNode::mutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    StaticNode *&StaticNode::head()
+    {
+        static StaticNode *head = nullptr;
+        return head;
+    }
+
+    std::atomic<uint64_t> &StaticNode::version()
+    {
+        static std::atomic<uint64_t> version = 0;
+        return version;
+    }
+
+    StaticNode::StaticNode(std::string_view name_, std::span<const TagView> tags_, uint64_t hash_,
+                           const std::atomic<size_t> &value_)
+        : name(name_), tags(tags_), hash(hash_), value(value_)
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        next = head();
+        if (next) next->prev = this;
+        head() = this;
+        version()++;
+    }
+
+    StaticNode::~StaticNode()
+    {
+        // Выгрузка модуля с метрикой: Metric удаляется до того, как станет недоступна статическая память
+        std::lock_guard<std::mutex> lock(mutex());
+        mirror.reset();
+        if (prev) prev->next = next;
+        else head() = next;
+        if (next) next->prev = prev;
+        version()++;
+    }
+
+    void StaticNode::mirrorAll(uint64_t &seen)
+    {
+        if (version().load(std::memory_order_acquire) == seen) return;
+        std::lock_guard<std::mutex> lock(mutex());
+        for (auto node = head(); node; node = node->next)
+            if (!node->mirror) node->mirror = std::make_unique<StaticMirror>(*node);
+        seen = version();
+    }
+
+    void StaticNode::releaseAll()
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        for (auto node = head(); node; node = node->next) node->mirror.reset();
+        version()++;
+    }
+
+} // namespace Metrics
@@ -0,0 +1,109 @@
+#pragma once
+#include "Metrics.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+
+namespace Metrics
+{
+
+    /// Строка как параметр шаблона: StaticCounter<"requests">
+    template <size_t N> struct FixedString {
+        char data[N] = {};
+        constexpr FixedString(const char (&text)[N]) { std::copy_n(text, N, data); }
+        constexpr std::string_view view() const { return {data, N - 1}; }
+    };
+
+    template <FixedString Key, FixedString Value> struct StaticTag {
+        static constexpr TagView tag = {Key.view(), Value.view()};
+    };
+
+    /// Метрика, объявленная при компиляции. Лежит в статической памяти и связывается в список при загрузке
+    /// модуля, без выделений памяти и без обращения к MetricsModel. Модель создает для каждого узла обычную
+    /// Metric при первом такте, в котором узел виден, поэтому загрузчики получают его как любую другую метрику.
+    struct StaticNode {
+        StaticNode(std::string_view name, std::span<const TagView> sorted_tags, uint64_t hash,
+                   const std::atomic<size_t> &value);
+        ~StaticNode();
+        StaticNode(const StaticNode &)            = delete;
+        StaticNode &operator=(const StaticNode &) = delete;
+
+        std::string_view name;
+        std::span<const TagView> tags; /// Отсортированы по ключу
+        uint64_t hash;
+        const std::atomic<size_t> &value;
+        StaticNode *prev = nullptr;
+        StaticNode *next = nullptr;
+        std::unique_ptr<Metric> mirror; /// Создается и удаляется под mutex()
+
+        static std::mutex &mutex();
+        static StaticNode *&head();
+        static std::atomic<uint64_t> &version(); /// Растет при каждом связывании и удалении узла
+
+        /// Вызывается MetricsModel на такте: создает Metric для новых узлов, если version() != seen
+        static void mirrorAll(uint64_t &seen);
+        /// Удаляет все Metric узлов, вызывается перед удалением MetricsModel
+        static void releaseAll();
+    };
+
+    namespace detail
+    {
+        template <size_t N, size_t M> constexpr auto concat(const FixedString<N> &a, const char (&b)[M])
+        {
+            char text[N + M - 1] = {};
+            std::copy_n(a.data, N - 1, text);
+            std::copy_n(b, M, text + N - 1);
+            return FixedString<N + M - 1>(text);
+        }
+
+        /// Устойчивая сортировка вставками, как std::stable_sort в KeyTable::intern, но constexpr
+        template <size_t N> constexpr std::array<TagView, N> sortTags(std::array<TagView, N> tags)
+        {
+            for (size_t i = 1; i < N; i++)
+                for (size_t j = i; j > 0 && tags[j].first < tags[j - 1].first; j--) std::swap(tags[j], tags[j - 1]);
+            return tags;
+        }
+    } // namespace detail
+
+    /// Counter с именем и тегами, известными при компиляции:
+    ///     Metrics::StaticCounter<"requests", Metrics::StaticTag<"peer", "api">> requests;
+    /// Ключ, сортировка тегов и хэш серии считаются constexpr, значение — одна атомарная переменная
+    /// в своей кэш-линии. Все объекты одного типа — одна и та же серия.
+    template <FixedString Name, class... Tags> class StaticCounter
+    {
+    public:
+        static constexpr auto name = detail::concat(Name, "_counter");
+        static constexpr std::array<TagView, sizeof...(Tags)> tags =
+            detail::sortTags(std::array<TagView, sizeof...(Tags)>{Tags::tag...});
+        static constexpr uint64_t hash = KeyTable::hash(name.view(), tags);
+
+        StaticCounter() { (void)&node; }
+
+        StaticCounter &operator++(int) noexcept
+        {
+            value.fetch_add(1, std::memory_order_relaxed);
+            return *this;
+        }
+        StaticCounter &operator+=(size_t val) noexcept
+        {
+            value.fetch_add(val, std::memory_order_relaxed);
+            return *this;
+        }
+        size_t exchange(size_t val = 0) noexcept { return value.exchange(val, std::memory_order_relaxed); }
+        operator size_t() const noexcept { return value.load(std::memory_order_relaxed); }
+
+    private:
+        struct alignas(64) Storage : std::atomic<size_t> {
+            constexpr Storage() : std::atomic<size_t>(0) {}
+        };
+        static constinit inline Storage value;
+        static inline StaticNode node{name.view(), tags, hash, value};
+    };
+
+} // namespace Metrics